@@ -0,0 +1,174 @@
+#include "BlockTable.h"
+#include <utility>
+
+const int BlockTable::NONE;
+
+// - Creates an empty table
+BlockTable::BlockTable() : first(NONE), last(NONE), count(0)
+{
+}
+
+// - Sets or clears a row's bit in a bitmap
+void BlockTable::setBit(std::vector<unsigned int> &bits, int row, bool value)
+{
+	if (value)
+		bits[row / 32] |= 1u << (row % 32);
+	else
+		bits[row / 32] &= ~(1u << (row % 32));
+}
+
+// - Takes a row for a new unused block, reusing a removed block's row when
+//   there is one. Links are left for the caller to fill in.
+int BlockTable::addRow(size_t blockOffset, size_t blockSize)
+{
+	int row;
+	if (!freeRows.empty())
+	{
+		row = freeRows.back();
+		freeRows.pop_back();
+		offset[row] = blockOffset;
+		size[row] = blockSize;
+		prevFree[row] = nextFree[row] = NONE;
+		handle[row] = 0;
+	}
+	else
+	{
+		row = (int)offset.size();
+		offset.push_back(blockOffset);
+		size.push_back(blockSize);
+		prevBlock.push_back(NONE);
+		nextBlock.push_back(NONE);
+		prevFree.push_back(NONE);
+		nextFree.push_back(NONE);
+		handle.push_back(0);
+		if (row % 32 == 0)
+		{
+			usedBits.push_back(0);
+			fixedBits.push_back(0);
+		}
+	}
+
+	setBit(usedBits, row, false);
+	setBit(fixedBits, row, false);
+	count++;
+	return row;
+}
+
+// - Returns the block at the lowest address, NONE if there are none
+int BlockTable::First() const
+{
+	return first;
+}
+
+// - Returns the number of blocks
+int BlockTable::Count() const
+{
+	return count;
+}
+
+// - Adds an unused block after every other block
+int BlockTable::Append(size_t blockOffset, size_t blockSize)
+{
+	int row = addRow(blockOffset, blockSize);
+	prevBlock[row] = last;
+	nextBlock[row] = NONE;
+	if (last != NONE)
+		nextBlock[last] = row;
+	else
+		first = row;
+	last = row;
+	return row;
+}
+
+// - Adds an unused block physically following another
+int BlockTable::InsertAfter(int block, size_t blockOffset, size_t blockSize)
+{
+	int row = addRow(blockOffset, blockSize);
+	int after = nextBlock[block];
+	prevBlock[row] = block;
+	nextBlock[row] = after;
+	nextBlock[block] = row;
+	if (after != NONE)
+		prevBlock[after] = row;
+	else
+		last = row;
+	return row;
+}
+
+// - Removes a block, leaving its row to be reused
+void BlockTable::Remove(int block)
+{
+	int before = prevBlock[block];
+	int after = nextBlock[block];
+	if (before != NONE)
+		nextBlock[before] = after;
+	else
+		first = after;
+	if (after != NONE)
+		prevBlock[after] = before;
+	else
+		last = before;
+
+	prevBlock[block] = nextBlock[block] = NONE;
+	setBit(usedBits, block, false);
+	setBit(fixedBits, block, false);
+	freeRows.push_back(block);
+	count--;
+}
+
+// - Removes every block, keeping the storage for reuse
+void BlockTable::Clear()
+{
+	usedBits.clear();
+	fixedBits.clear();
+	freeRows.clear();
+	offset.clear();
+	size.clear();
+	prevBlock.clear();
+	nextBlock.clear();
+	prevFree.clear();
+	nextFree.clear();
+	handle.clear();
+	first = last = NONE;
+	count = 0;
+}
+
+// - Exchanges contents with another table without copying
+void BlockTable::Swap(BlockTable &other)
+{
+	usedBits.swap(other.usedBits);
+	fixedBits.swap(other.fixedBits);
+	freeRows.swap(other.freeRows);
+	offset.swap(other.offset);
+	size.swap(other.size);
+	prevBlock.swap(other.prevBlock);
+	nextBlock.swap(other.nextBlock);
+	prevFree.swap(other.prevFree);
+	nextFree.swap(other.nextFree);
+	handle.swap(other.handle);
+	std::swap(first, other.first);
+	std::swap(last, other.last);
+	std::swap(count, other.count);
+}
+
+// - Whether a block is allocated
+bool BlockTable::IsUsed(int block) const
+{
+	return (usedBits[block / 32] >> (block % 32) & 1) != 0;
+}
+
+void BlockTable::SetUsed(int block, bool used)
+{
+	setBit(usedBits, block, used);
+}
+
+// - Whether a block must never be moved by Compact
+bool BlockTable::IsFixed(int block) const
+{
+	return (fixedBits[block / 32] >> (block % 32) & 1) != 0;
+}
+
+void BlockTable::SetFixed(int block, bool fixed)
+{
+	setBit(fixedBits, block, fixed);
+}
@@ -0,0 +1,68 @@
+#ifndef BLOCKTABLE_H
+#define BLOCKTABLE_H
+
+#include <cstddef>
+#include <vector>
+
+// Block records of an arena stored column by column. A block is a row index
+// into the parallel arrays and rows are chained in address order. Rows of
+// removed blocks are reused so a busy table stops allocating once it has
+// grown to its working size. Tables built by Append alone have rows in
+// address order, which is what Compact does.
+class BlockTable
+{
+private:
+	std::vector<unsigned int> usedBits;		// One bit per row
+	std::vector<unsigned int> fixedBits;
+	std::vector<int> freeRows;				// Rows of removed blocks available for reuse
+	int first;
+	int last;
+	int count;
+
+	int addRow(size_t offset, size_t size);
+	static void setBit(std::vector<unsigned int> &bits, int row, bool value);
+
+public:
+	static const int NONE = -1;
+
+	std::vector<size_t> offset;				// Start of each block within the arena
+	std::vector<size_t> size;
+	std::vector<int> prevBlock;				// Physically neighbouring blocks
+	std::vector<int> nextBlock;
+	std::vector<int> prevFree;				// Neighbours in the free list of the block's size class
+	std::vector<int> nextFree;
+	std::vector<int> handle;				// Owning handle, 0 for raw pointer allocations
+
+	// - Creates an empty table
+	BlockTable();
+
+	// - Returns the block at the lowest address, NONE if there are none
+	int First() const;
+
+	// - Returns the number of blocks
+	int Count() const;
+
+	// - Adds an unused block after every other block
+	int Append(size_t offset, size_t size);
+
+	// - Adds an unused block physically following another
+	int InsertAfter(int block, size_t offset, size_t size);
+
+	// - Removes a block, leaving its row to be reused
+	void Remove(int block);
+
+	// - Removes every block, keeping the storage for reuse
+	void Clear();
+
+	// - Exchanges contents with another table without copying
+	void Swap(BlockTable &other);
+
+	// - Whether a block is allocated
+	bool IsUsed(int block) const;
+	void SetUsed(int block, bool used);
+
+	// - Whether a block must never be moved by Compact
+	bool IsFixed(int block) const;
+	void SetFixed(int block, bool fixed);
+};
+#endif
@@ -0,0 +1,334 @@
+#include "BuddyAllocator.h"
+#include <cstring>
+
+const size_t BuddyAllocator::NO_BLOCK;
+
+// Free blocks start with links to their neighbours in their order's list
+struct FreeLinks
+{
+	size_t prev;
+	size_t next;
+};
+
+// - Creates an allocator managing nothing
+BuddyAllocator::BuddyAllocator() : memory(NULL), state(&ownState), freeBits(NULL), splitBits(NULL)
+{
+	ownState.capacity = 0;
+	ownState.topOrder = MIN_ORDER;
+	for (int i = 0; i < MAX_ORDERS; i++)
+		ownState.freeHeads[i] = NO_BLOCK;
+	ownState.nonEmpty = 0;
+	ownState.freeCount = 0;
+	ownState.usedCount = 0;
+}
+
+// - Copies another allocator's state into storage of its own
+BuddyAllocator::BuddyAllocator(BuddyAllocator const &other) : state(&ownState)
+{
+	*this = other;
+}
+
+// - Copies another allocator's state into storage of its own
+BuddyAllocator& BuddyAllocator::operator=(BuddyAllocator const &other)
+{
+	if (this == &other)
+		return *this;
+
+	memory = other.memory;
+	ownState = *other.state;
+	state = &ownState;
+	size_t words = other.freeBits != NULL ? BitmapWords(ownState.topOrder) : 0;
+	ownBits.assign(other.freeBits, other.freeBits + words);
+	ownBits.insert(ownBits.end(), other.splitBits, other.splitBits + words);
+	freeBits = words > 0 ? &ownBits[0] : NULL;
+	splitBits = words > 0 ? &ownBits[words] : NULL;
+	return *this;
+}
+
+// - Index of a block in the implicit tree, the root being 1 and the
+//   children of node n being 2n and 2n + 1
+size_t BuddyAllocator::nodeOf(size_t offset, int order) const
+{
+	return ((size_t)1 << (state->topOrder - order)) + (offset >> order);
+}
+
+bool BuddyAllocator::testBit(unsigned int const *bits, size_t node) const
+{
+	return (bits[node / 32] >> (node % 32) & 1) != 0;
+}
+
+void BuddyAllocator::setBit(unsigned int *bits, size_t node, bool value)
+{
+	if (value)
+		bits[node / 32] |= 1u << (node % 32);
+	else
+		bits[node / 32] &= ~(1u << (node % 32));
+}
+
+// - Adds a block to the front of its order's free list
+void BuddyAllocator::pushFree(size_t offset, int order)
+{
+	FreeLinks links = { NO_BLOCK, state->freeHeads[order] };
+	memcpy(memory + offset, &links, sizeof(links));
+	if (links.next != NO_BLOCK)
+		memcpy(memory + links.next, &offset, sizeof(offset));
+	state->freeHeads[order] = offset;
+	state->nonEmpty |= 1ull << order;
+	state->freeCount++;
+	setBit(freeBits, nodeOf(offset, order), true);
+}
+
+// - Unlinks a block from its order's free list. The links are nulled so
+//   blocks no longer free only hold what was last written to them.
+void BuddyAllocator::removeFree(size_t offset, int order)
+{
+	FreeLinks links;
+	memcpy(&links, memory + offset, sizeof(links));
+	if (links.prev != NO_BLOCK)
+		memcpy(memory + links.prev + sizeof(size_t), &links.next, sizeof(size_t));
+	else
+		state->freeHeads[order] = links.next;
+	if (links.next != NO_BLOCK)
+		memcpy(memory + links.next, &links.prev, sizeof(size_t));
+	if (state->freeHeads[order] == NO_BLOCK)
+		state->nonEmpty &= ~(1ull << order);
+	state->freeCount--;
+
+	memset(memory + offset, 0, sizeof(links));
+	setBit(freeBits, nodeOf(offset, order), false);
+}
+
+// - Takes the first block of an order's free list
+size_t BuddyAllocator::popFree(int order)
+{
+	size_t offset = state->freeHeads[order];
+	removeFree(offset, order);
+	return offset;
+}
+
+// - Frees the parts of a node inside the managed range. Nodes straddling
+//   the end are split, nodes past it are left looking allocated.
+void BuddyAllocator::addRange(size_t node, int order, size_t offset)
+{
+	size_t size = (size_t)1 << order;
+	if (offset >= state->capacity)
+		return;
+	if (offset + size <= state->capacity)
+	{
+		pushFree(offset, order);
+		return;
+	}
+
+	setBit(splitBits, node, true);
+	addRange(node * 2, order - 1, offset);
+	addRange(node * 2 + 1, order - 1, offset + size / 2);
+}
+
+// - Walks down from the root to the unsplit block holding offset, returning
+//   its order
+int BuddyAllocator::findContaining(size_t offset, size_t &node) const
+{
+	int order = state->topOrder;
+	node = 1;
+	while (testBit(splitBits, node))
+	{
+		order--;
+		node = node * 2 + (offset >> order & 1);
+	}
+	return order;
+}
+
+// - Walks down from the root to the unsplit block starting at offset,
+//   returning its order or -1 if no block starts there
+int BuddyAllocator::findBlock(size_t offset, size_t &node) const
+{
+	if (offset >= state->capacity || offset % MIN_BLOCK != 0)
+		return -1;
+
+	int order = findContaining(offset, node);
+	return offset % ((size_t)1 << order) == 0 ? order : -1;
+}
+
+// - Words in each bitmap of a tree with a root of the given order
+size_t BuddyAllocator::BitmapWords(int topOrder)
+{
+	size_t nodes = (size_t)2 << (topOrder - MIN_ORDER);
+	return nodes / 32 + 1;
+}
+
+// - Order of the smallest block covering capacity bytes
+int BuddyAllocator::TopOrder(size_t capacity)
+{
+	int order = MIN_ORDER;
+	while (((size_t)1 << order) < capacity)
+		order++;
+	return order;
+}
+
+// - Bytes of bitmap needed to manage size bytes
+size_t BuddyAllocator::BitmapBytes(size_t size)
+{
+	return 2 * BitmapWords(TopOrder(size & ~(MIN_BLOCK - 1))) * sizeof(unsigned int);
+}
+
+// - Starts managing size bytes of memory, all of it free
+void BuddyAllocator::Reset(char *start, size_t size)
+{
+	state = &ownState;
+	ownBits.assign(BitmapBytes(size) / sizeof(unsigned int), 0);
+	initialise(start, size, &ownBits[0]);
+}
+
+// - Starts managing memory with the state and bitmaps in the caller's storage
+void BuddyAllocator::Reset(char *start, size_t size, State *external, unsigned int *bits)
+{
+	state = external;
+	ownBits.clear();
+	memset(bits, 0, BitmapBytes(size));
+	initialise(start, size, bits);
+}
+
+// - Frees the whole of memory into empty state and bitmaps
+void BuddyAllocator::initialise(char *start, size_t size, unsigned int *bits)
+{
+	memory = start;
+	state->capacity = size & ~(MIN_BLOCK - 1);
+	state->topOrder = TopOrder(state->capacity);
+	freeBits = bits;
+	splitBits = bits + BitmapWords(state->topOrder);
+	for (int i = 0; i < MAX_ORDERS; i++)
+		state->freeHeads[i] = NO_BLOCK;
+	state->nonEmpty = 0;
+	state->freeCount = 0;
+	state->usedCount = 0;
+	addRange(1, state->topOrder, 0);
+}
+
+// - Carries on with the state and bitmaps left in the caller's storage
+void BuddyAllocator::Attach(char *start, State *external, unsigned int *bits)
+{
+	memory = start;
+	state = external;
+	ownBits.clear();
+	freeBits = bits;
+	splitBits = bits + BitmapWords(state->topOrder);
+}
+
+// - Points at a copy of the memory, which holds the free lists
+void BuddyAllocator::Rebase(char *start)
+{
+	memory = start;
+}
+
+// - Returns the number of bytes managed
+size_t BuddyAllocator::Capacity() const
+{
+	return state->capacity;
+}
+
+// - Size of the block an allocation of size bytes would get
+size_t BuddyAllocator::RoundUp(size_t size)
+{
+	size_t block = MIN_BLOCK;
+	while (block < size)
+		block <<= 1;
+	return block;
+}
+
+// - Takes the smallest free block that fits, splitting it down to size
+size_t BuddyAllocator::Alloc(size_t size)
+{
+	if (size == 0 || size > state->capacity)
+		return NO_BLOCK;
+
+	int order = MIN_ORDER;
+	while (((size_t)1 << order) < size)
+		order++;
+
+	unsigned long long candidates = state->nonEmpty & (~0ull << order);
+	if (candidates == 0)
+		return NO_BLOCK;
+	int found = order;
+	while ((candidates >> found & 1) == 0)
+		found++;
+
+	// Keep the lower half of each split, freeing the upper half
+	size_t offset = popFree(found);
+	while (found > order)
+	{
+		setBit(splitBits, nodeOf(offset, found), true);
+		found--;
+		pushFree(offset + ((size_t)1 << found), found);
+	}
+	state->usedCount++;
+	return offset;
+}
+
+// - Returns the size of the allocated block at offset, 0 if there is none
+size_t BuddyAllocator::BlockSize(size_t offset) const
+{
+	size_t node;
+	int order = findBlock(offset, node);
+	if (order < 0 || testBit(freeBits, node))
+		return 0;
+	return (size_t)1 << order;
+}
+
+// - Returns the offset of the allocated block holding offset, NO_BLOCK if
+//   there is none
+size_t BuddyAllocator::BlockStart(size_t offset) const
+{
+	if (offset >= state->capacity)
+		return NO_BLOCK;
+
+	size_t node;
+	int order = findContaining(offset, node);
+	if (testBit(freeBits, node))
+		return NO_BLOCK;
+	return offset & ~(((size_t)1 << order) - 1);
+}
+
+// - Frees the allocated block at offset, merging it with free buddies
+void BuddyAllocator::Free(size_t offset)
+{
+	size_t node;
+	int order = findBlock(offset, node);
+	if (order < 0 || testBit(freeBits, node))
+		return;
+
+	state->usedCount--;
+	while (order < state->topOrder && testBit(freeBits, node ^ 1))
+	{
+		size_t buddy = offset ^ ((size_t)1 << order);
+		removeFree(buddy, order);
+		node /= 2;
+		order++;
+		setBit(splitBits, node, false);
+		if (buddy < offset)
+			offset = buddy;
+	}
+	pushFree(offset, order);
+}
+
+// - Returns the size of the largest free block
+size_t BuddyAllocator::LargestFree() const
+{
+	for (int order = MAX_ORDERS - 1; order >= MIN_ORDER; order--)
+	{
+		if (state->nonEmpty >> order & 1)
+			return (size_t)1 << order;
+	}
+	return 0;
+}
+
+// - Returns the number of free blocks
+size_t BuddyAllocator::FreeBlocks() const
+{
+	return state->freeCount;
+}
+
+// - Returns the number of allocated blocks
+size_t BuddyAllocator::UsedBlocks() const
+{
+	return state->usedCount;
+}
@@ -0,0 +1,108 @@
+#ifndef BUDDYALLOCATOR_H
+#define BUDDYALLOCATOR_H
+
+#include <cstddef>
+#include <vector>
+
+// Binary buddy system over a range of memory. Blocks are powers of two in
+// size and start at a multiple of their size. Two bitmaps over the implicit
+// tree of blocks record which are free and which are split, so finding a
+// block's size and its buddy's state both take O(log n). Free blocks of each
+// size are linked through their first MIN_BLOCK bytes by offset.
+class BuddyAllocator
+{
+public:
+	static const int MIN_ORDER = 4;
+	static const size_t MIN_BLOCK = (size_t)1 << MIN_ORDER;
+	static const size_t NO_BLOCK = ~(size_t)0;
+
+	static const int MAX_ORDERS = 64;
+
+	// Everything but the bitmaps, kept together so that it can live in a
+	// file alongside the memory it describes
+	struct State
+	{
+		size_t capacity;					// Managed bytes, a multiple of MIN_BLOCK
+		int topOrder;						// Order of the root of the tree
+		size_t freeHeads[MAX_ORDERS];		// First free block of each order
+		unsigned long long nonEmpty;		// One bit per order with free blocks
+		size_t freeCount;					// Blocks on the free lists
+		size_t usedCount;					// Blocks handed out and not yet freed
+	};
+
+private:
+	char *memory;
+	State *state;							// ownState unless storage was handed in
+	State ownState;
+	unsigned int *freeBits;					// One bit per tree node
+	unsigned int *splitBits;
+	std::vector<unsigned int> ownBits;		// Both bitmaps unless storage was handed in
+
+	size_t nodeOf(size_t offset, int order) const;
+	bool testBit(unsigned int const *bits, size_t node) const;
+	void setBit(unsigned int *bits, size_t node, bool value);
+	static size_t BitmapWords(int topOrder);
+	static int TopOrder(size_t capacity);
+	void initialise(char *memory, size_t size, unsigned int *bits);
+	void pushFree(size_t offset, int order);
+	void removeFree(size_t offset, int order);
+	size_t popFree(int order);
+	void addRange(size_t node, int order, size_t offset);
+	int findContaining(size_t offset, size_t &node) const;
+	int findBlock(size_t offset, size_t &node) const;
+
+public:
+	// - Creates an allocator managing nothing
+	BuddyAllocator();
+
+	// - Copies another allocator's state into storage of its own
+	BuddyAllocator(BuddyAllocator const &other);
+	BuddyAllocator& operator=(BuddyAllocator const &other);
+
+	// - Starts managing size bytes of memory, all of it free
+	void Reset(char *memory, size_t size);
+
+	// - As Reset, keeping the state and BitmapBytes(size) of bitmaps in
+	//   storage the caller owns, such as a mapped file
+	void Reset(char *memory, size_t size, State *state, unsigned int *bits);
+
+	// - Carries on managing memory with the state and bitmaps a Reset into
+	//   the same storage left there
+	void Attach(char *memory, State *state, unsigned int *bits);
+
+	// - Bytes of bitmap needed to manage size bytes
+	static size_t BitmapBytes(size_t size);
+
+	// - Points at a copy of the memory, which holds the free lists
+	void Rebase(char *memory);
+
+	// - Returns the number of bytes managed
+	size_t Capacity() const;
+
+	// - Takes a block of at least size bytes, returning its offset or
+	//   NO_BLOCK if there is none
+	size_t Alloc(size_t size);
+
+	// - Returns the size of the allocated block at offset, 0 if there is none
+	size_t BlockSize(size_t offset) const;
+
+	// - Returns the offset of the allocated block holding offset, NO_BLOCK if
+	//   there is none
+	size_t BlockStart(size_t offset) const;
+
+	// - Frees the allocated block at offset, merging it with free buddies
+	void Free(size_t offset);
+
+	// - Returns the size of the largest free block
+	size_t LargestFree() const;
+
+	// - Returns the number of free blocks
+	size_t FreeBlocks() const;
+
+	// - Returns the number of allocated blocks
+	size_t UsedBlocks() const;
+
+	// - Size of the block an allocation of size bytes would get
+	static size_t RoundUp(size_t size);
+};
+#endif
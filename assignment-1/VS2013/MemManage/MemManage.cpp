@@ -1,71 +1,272 @@
 #include "MemManage.h"
-#include <iomanip>
+#include "PageArena.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MEMMANAGE_SSE2
+#endif
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
 
 using namespace std;
+using namespace std::chrono;
 
-// - Search method for finding unused blocks
-bool FindUnusedBlock(Node<MemoryBlock> const &node, void const *size)
+// Heap ids handed out so far
+static atomic<unsigned int> heapCount(0);
+
+// The thread cache this thread used last and the id of its heap, so threads
+// working with a single heap find their cache without locking
+static THREAD_LOCAL unsigned int lastHeapId = 0;
+static THREAD_LOCAL void *lastHeapCache = NULL;
+
+// Start of an ARENA_FILE heap's file or an ARENA_SHARED heap's segment. The
+// buddy allocator's bitmaps come next and then the arena, each starting on a
+// page of its own.
+struct MemManage::FileHeader
+{
+	char magic[8];
+	unsigned int wordSize;				// sizeof(size_t) in the build that laid out the file
+	atomic<unsigned int> ready;			// Set once the rest is laid out
+	unsigned long long lock[PROCESS_LOCK_BYTES / sizeof(unsigned long long)];
+	size_t fileBytes;
+	size_t bitmapOffset;
+	size_t arenaOffset;
+	size_t arenaBytes;
+	size_t freeSpace;
+	size_t root;						// Arena offset of the root allocation, NO_ROOT for none
+	BuddyAllocator::State buddy;
+};
+
+// Every heap file starts with these bytes, the last being the layout version
+static const char FILE_MAGIC[8] = { 'M', 'e', 'm', 'H', 'e', 'a', 'p', '1' };
+static const size_t NO_ROOT = ~(size_t)0;
+
+const size_t MemManage::NO_OFFSET;
+
+// How long opening a shared heap waits for the process that created it to
+// lay it out, in milliseconds
+static const int SHARED_OPEN_WAIT = 1000;
+
+// Holds an ARENA_SHARED heap's process lock for a scope, taking freeSpace
+// from its header and putting it back after. A file heap's header is kept
+// up to date the same way, unlocked. Does nothing for any other heap.
+struct MemManage::SharedGuard
+{
+	MemManage &heap;
+
+	SharedGuard(MemManage &owner) : heap(owner)
+	{
+		if (heap.processLock != NO_PROCESS_LOCK)
+			LockProcesses(heap.processLock);
+		if (heap.fileHeader != NULL)
+			heap.freeSpace = heap.fileHeader->freeSpace;
+	}
+
+	~SharedGuard()
+	{
+		if (heap.fileHeader != NULL)
+			heap.fileHeader->freeSpace = heap.freeSpace;
+		if (heap.processLock != NO_PROCESS_LOCK)
+			UnlockProcesses(heap.processLock);
+	}
+};
+
+// - Index of the most significant set bit
+static int HighestBit(unsigned int value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse(&index, value);
+	return (int)index;
+#else
+	return 31 - __builtin_clz(value);
+#endif
+}
+
+// - Index of the most significant set bit of a size
+static int HighestBit64(unsigned long long value)
+{
+#if defined(_MSC_VER) && defined(_WIN64)
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return (int)index;
+#elif defined(_MSC_VER)
+	unsigned int high = (unsigned int)(value >> 32);
+	return high != 0 ? 32 + HighestBit(high) : HighestBit((unsigned int)value);
+#else
+	return 63 - __builtin_clzll(value);
+#endif
+}
+
+// - Histogram bucket a value is counted in
+static int StatsBucket(unsigned long long value)
+{
+	if (value == 0)
+		return 0;
+	int bucket = HighestBit64(value) + 1;
+	return bucket < STATS_BUCKETS ? bucket : STATS_BUCKETS - 1;
+}
+
+// Calls this thread has made, to pick the ones the latency counters time
+static THREAD_LOCAL unsigned int opTick = 0;
+
+// - Nanosecond clock for the latency counters
+static unsigned long long OpClock()
 {
-	const MemoryBlock *mb = &(node.info);
-	return !mb->isUsed && mb->size >= *(int*)size;
+	return (unsigned long long)duration_cast<nanoseconds>(high_resolution_clock::now().time_since_epoch()).count();
 }
 
-// - Search method for linked list
-bool FindMemoryBlockByPtr(Node<MemoryBlock> const &node, void const *ptr)
+// - Start time of a call the latency counters sample, 0 for the rest
+static unsigned long long OpStart()
 {
-    return node.info.startPtr == ptr;
+#if MEMMANAGE_LATENCY_STATS
+	if (++opTick % LATENCY_SAMPLE == 0)
+		return OpClock();
+#endif
+	return 0;
 }
 
-// - Search method for MemoryBlock comparing memory blocks
-bool FindMemoryBlock(Node<MemoryBlock> const &node, void const *mbPtr)
+// - Index of the least significant set bit
+static int LowestBit(unsigned int value)
 {
-	return node.info.startPtr == ((MemoryBlock*)mbPtr)->startPtr
-		&& node.info.size == ((MemoryBlock*)mbPtr)->size
-		&& node.info.isUsed == ((MemoryBlock*)mbPtr)->isUsed;
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, value);
+	return (int)index;
+#else
+	return __builtin_ctz(value);
+#endif
 }
 
 // - Performs a deep copy
 void MemManage::copyMemManage(MemManage const& otherMemManage)
 {
+	unique_lock<recursive_mutex> lock = otherMemManage.lockHeap();
+	// Only the other heap's cached free space is refreshed under the guard
+	SharedGuard guard(const_cast<MemManage&>(otherMemManage));
+	heapId = ++heapCount;
+	options = otherMemManage.options;
+	spanClasses = otherMemManage.spanClasses;
 	maxSpace = otherMemManage.maxSpace;
 	freeSpace = otherMemManage.freeSpace;
-	memory = new char[maxSpace];
-	assert(memory != NULL);
-	for (int i = 0; i < maxSpace; i++)
-		memory[i] = otherMemManage.memory[i];
-	memoryBlocks = otherMemManage.memoryBlocks;
-	if (memoryBlocks.length() > 0)
-	{
-		// Pointers in the linked list are shallow copied so need to rebuild the pointers
-		LinkedList<MemoryBlock>::iterator it = memoryBlocks.begin();
-		int offset = 0;
-		do
-		{
-			(*it).startPtr = &memory[offset];
-			offset += (*it).size;
-		} while (it++ != memoryBlocks.end());
+	if (options.backend == ARENA_FILE || options.backend == ARENA_SHARED)
+	{
+		options.backend = ARENA_HEAP;
+		options.path = NULL;
 	}
+	if (options.backend == ARENA_SNAPSHOT)
+		memory = shareArena(otherMemManage);
+	else
+	{
+		// Nothing past untouched has been handed out, so it is still null,
+		// apart from the buddy allocator's links in its free blocks
+		size_t used = otherMemManage.untouched - otherMemManage.memory;
+		if (options.allocator == ALLOCATOR_BUDDY)
+			used = maxSpace;
+		memory = allocArena(maxSpace);
+		if (memory != NULL && options.backend == ARENA_PAGES)
+			CommitPages(memory, used);
+		if (memory != NULL)
+			memcpy(memory, otherMemManage.memory, used);
+	}
+	assert(memory != NULL || maxSpace == 0);
+	untouched = memory + (otherMemManage.untouched - otherMemManage.memory);
+
+	// Block records hold offsets rather than pointers so copy over as they are
+	blocks = otherMemManage.blocks;
+	buddy = otherMemManage.buddy;
+	buddy.Rebase(memory);
+	regionTop = otherMemManage.regionTop;
+	regionLast = otherMemManage.regionLast;
+	trace = NULL;
+	counters = OpCounters();
+	for (int i = 0; i < STATS_BUCKETS; i++)
+		searchLengths[i] = 0;
+	handles = otherMemManage.handles;
+	freeHandles = otherMemManage.freeHandles;
+	rebuildIndexes();
+	copySpans(otherMemManage);
+	copyChunks(otherMemManage);
 }
 
 // - Performs a deep copy
 MemManage& MemManage::operator=(MemManage const& rhs)
 {
-	copyMemManage(rhs);
+	if (this != &rhs)
+	{
+		freeArena();
+		destroySpans();
+		destroyChunks();
+		copyMemManage(rhs);
+	}
     return *this;
 }
 
 // - Creates initial memory array
-MemManage::MemManage(int maxsize)
+MemManage::MemManage(size_t maxsize) : MemManage(maxsize, MemManageOptions())
 {
-	memory = new char[maxsize];
+}
 
-	// initialize memory to nulls
-	for (int i = 0; i < maxsize; i++)
-		memory[i] = '\0';
+// - Creates initial memory array with the given settings
+MemManage::MemManage(size_t maxsize, MemManageOptions const& opts) : options(opts)
+{
+	if (options.backend == ARENA_FILE || options.backend == ARENA_SHARED)
+	{
+		options.allocator = ALLOCATOR_BUDDY;
+		options.growable = false;
+		memory = openFile(maxsize);
+	}
+	else
+		memory = allocArena(maxsize);
+	assert(memory != NULL || maxsize == 0);
+	untouched = fileHeader != NULL ? memory + maxsize : memory;
+	heapId = ++heapCount;
 
-    memoryBlocks = LinkedList<MemoryBlock>();
     freeSpace = maxsize;
     maxSpace = maxsize;
+	regionTop = 0;
+	regionLast = maxsize;
+	trace = NULL;
+	for (int i = 0; i < STATS_BUCKETS; i++)
+		searchLengths[i] = 0;
+
+	spanClasses = 0;
+	if (options.allocator == ALLOCATOR_FREE_LIST)
+		spanClasses = options.threadSafe ? CACHED_CLASSES : options.slabs ? SLAB_CLASSES : 0;
+	for (int i = 0; i < CACHED_CLASSES; i++)
+		abandonedSpans[i] = NULL;
+	if (spanClasses > 0)
+		spanMap.assign(maxsize / SPAN_SIZE, (Span*)NULL);
+
+	// All memory starts out as a single unused block, the buddy allocator
+	// only manages whole multiples of its smallest block. It links its free
+	// blocks through the blocks themselves, anywhere in the arena, so page
+	// backed arenas are committed up front for it. A file heap's allocator
+	// was set up by openFile.
+	if (fileHeader != NULL)
+		freeSpace = fileHeader->freeSpace;
+	else if (options.allocator == ALLOCATOR_BUDDY)
+	{
+		if (options.backend == ARENA_PAGES)
+			CommitPages(memory, maxsize);
+		buddy.Reset(memory, maxsize);
+		freeSpace = buddy.Capacity();
+	}
+	else if (options.allocator == ALLOCATOR_FREE_LIST && maxsize > 0)
+		blocks.Append(0, maxsize);
+	rebuildIndexes();
 }
 
 // - Copy constructor
@@ -77,209 +278,2229 @@ MemManage::MemManage(MemManage const& otherMemManage)
 // - Frees all memory resources
 MemManage::~MemManage()
 {
+	destroySpans();
+	destroyChunks();
+	freeArena();
 	freeSpace = 0;
 	maxSpace = 0;
-	memoryBlocks.destroyList();
-	if (memory != NULL && memory[0] != NULL)
-    {
-        delete[] memory;
-        memory = NULL;
-    }
+	memory = NULL;
 }
 
-// - Returns a pointer to allocated memory
-void* MemManage::Alloc(int size)
+// - Gets storage for the arena from the configured backend. Memory only
+//   needs to start out null if nothing nulls it before it is handed out,
+//   calloc and fresh pages both get that without touching it. Pages are
+//   always aligned, heap storage is over-allocated to align it.
+char* MemManage::allocArena(size_t size)
 {
-	// Requested size must not be more than available
-    if (size > freeSpace)
-        return NULL;
+	heapArena = NULL;
+	pageFile = NO_PAGE_FILE;
+	fileHeader = NULL;
+	processLock = NO_PROCESS_LOCK;
+	copyOnWrite = false;
+	if (options.backend == ARENA_PAGES)
+		return size > 0 ? ReservePages(size, options.hugePages) : NULL;
+	if (options.backend == ARENA_SNAPSHOT)
+		return size > 0 ? MapFilePages(size, pageFile) : NULL;
+	if (options.zeroPolicy == ZERO_ON_FREE || options.zeroPolicy == ZERO_LAZY)
+		heapArena = calloc(size + ARENA_ALIGNMENT - 1, 1);
+	else
+		heapArena = malloc(size + ARENA_ALIGNMENT - 1);
+	if (heapArena == NULL)
+		return NULL;
+	return (char*)(((size_t)heapArena + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1));
+}
 
-	freeSpace -= size;
+// - Returns the arena's storage to wherever it came from
+void MemManage::freeArena()
+{
+	if (options.backend == ARENA_PAGES)
+		ReleasePages(memory, maxSpace);
+	else if (options.backend == ARENA_SNAPSHOT)
+		UnmapFilePages(memory, maxSpace, pageFile);
+	else if (options.backend == ARENA_FILE || options.backend == ARENA_SHARED)
+	{
+		CloseProcessLock(processLock);
+		if (fileHeader != NULL)
+			UnmapFilePages((char*)fileHeader, fileHeader->fileBytes, pageFile);
+	}
+	else
+		free(heapArena);
+}
+
+// - Maps the heap's file or segment and carries on with the heap in it,
+//   laying out a new one over size bytes of arena if it was just created.
+//   Sets size to the arena's size, or 0 if it could not be opened or holds
+//   something other than a heap this build can read.
+char* MemManage::openFile(size_t &size)
+{
+	heapArena = NULL;
+	pageFile = NO_PAGE_FILE;
+	fileHeader = NULL;
+	processLock = NO_PROCESS_LOCK;
+	copyOnWrite = false;
 
-	// First memory block
-    if (memoryBlocks.isEmpty())
-    {
-		MemoryBlock mb { size, memory, true };
-		memoryBlocks.insertLast(mb);
-		return mb.startPtr;
-    }
+	bool shared = options.backend == ARENA_SHARED;
+	size_t page = PageSize();
+	size_t bitmapOffset = (sizeof(FileHeader) + page - 1) & ~(page - 1);
+	size_t arenaOffset = bitmapOffset + ((BuddyAllocator::BitmapBytes(size) + page - 1) & ~(page - 1));
+	size_t fileBytes = 0;
+	bool created = false;
+	char *file = NULL;
+	if (options.path != NULL && shared)
+		file = MapSharedMemory(options.path, arenaOffset + size, fileBytes, created, pageFile);
+	else if (options.path != NULL)
+		file = MapNamedFile(options.path, arenaOffset + size, fileBytes, created, pageFile);
+	FileHeader *header = (FileHeader*)file;
+	string lockName = string(options.path != NULL ? options.path : "") + ".lock";
 
-    // Find unallocated space large enough to fit
-	MemoryBlock *mbPtr = memoryBlocks.search(FindUnusedBlock, &size);
-	if (mbPtr == NULL)
+	bool usable = false;
+	if (file != NULL && created)
 	{
-		// No unused blocks large enough found, add new to the end.
-		MemoryBlock mb, lastInserted = memoryBlocks.back();
-		mb.size = size;
-		mb.isUsed = true;
-		mb.startPtr = lastInserted.startPtr + lastInserted.size;
-		memoryBlocks.insertLast(mb);
-		return mb.startPtr;
+		memcpy(header->magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+		header->wordSize = sizeof(size_t);
+		header->fileBytes = fileBytes;
+		header->bitmapOffset = bitmapOffset;
+		header->arenaOffset = arenaOffset;
+		header->arenaBytes = size;
+		header->root = NO_ROOT;
+		buddy.Reset(file + arenaOffset, size, &header->buddy, (unsigned int*)(file + bitmapOffset));
+		header->freeSpace = buddy.Capacity();
+		if (shared)
+			processLock = OpenProcessLock(header->lock, lockName.c_str(), true);
+		usable = !shared || processLock != NO_PROCESS_LOCK;
+		header->ready.store(usable ? 1 : 0);
 	}
+	else if (file != NULL && fileBytes >= sizeof(FileHeader))
+	{
+		// Another process may still be laying out a shared heap it just created
+		for (int waited = 0; shared && header->ready.load() == 0 && waited < SHARED_OPEN_WAIT; waited++)
+			this_thread::sleep_for(milliseconds(1));
 
-	// Found space was larger than needed split it up
-	if (mbPtr->size > size)
+		usable = header->ready.load() != 0
+			&& memcmp(header->magic, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0
+			&& header->wordSize == sizeof(size_t)
+			&& header->fileBytes <= fileBytes
+			&& header->arenaOffset <= header->fileBytes && header->arenaBytes <= header->fileBytes - header->arenaOffset
+			&& header->bitmapOffset + BuddyAllocator::BitmapBytes(header->arenaBytes) <= header->arenaOffset
+			&& header->buddy.capacity == (header->arenaBytes & ~(BuddyAllocator::MIN_BLOCK - 1));
+		if (usable && shared)
+		{
+			processLock = OpenProcessLock(header->lock, lockName.c_str(), false);
+			usable = processLock != NO_PROCESS_LOCK;
+		}
+		if (usable)
+			buddy.Attach(file + header->arenaOffset, &header->buddy, (unsigned int*)(file + header->bitmapOffset));
+	}
+
+	if (!usable)
 	{
-		// New smaller unused block
-		MemoryBlock mb;
-		mb.size = mbPtr->size - size;
-		mb.startPtr = mbPtr->startPtr + size;
-		mb.isUsed = false;
-		memoryBlocks.insertAfter(FindMemoryBlock, *mbPtr, mb);
+		CloseProcessLock(processLock);
+		processLock = NO_PROCESS_LOCK;
+		UnmapFilePages(file, fileBytes, pageFile);
+		if (created && shared)
+			UnlinkSharedMemory(options.path);
+		pageFile = NO_PAGE_FILE;
+		size = 0;
+		return NULL;
+	}
+
+	fileHeader = header;
+	size = header->arenaBytes;
+	return file + header->arenaOffset;
+}
+
+// - Maps a copy-on-write view of another snapshot heap's arena. The first
+//   copy turns the other arena into such a view too, freezing their file.
+//   Later copies only need the pages the other heap has written since.
+//   Where the OS cannot remap in place the copy gets a file of its own.
+char* MemManage::shareArena(MemManage const &other)
+{
+	heapArena = NULL;
+	pageFile = NO_PAGE_FILE;
+	fileHeader = NULL;
+	processLock = NO_PROCESS_LOCK;
+	copyOnWrite = false;
+	if (other.maxSpace == 0)
+		return NULL;
 
-		// Resize block
-		mbPtr->size = size;
+	bool written = other.copyOnWrite;
+	if (!other.copyOnWrite)
+		other.copyOnWrite = MakeCopyOnWrite(other.memory, other.maxSpace, other.pageFile);
+	if (other.copyOnWrite)
+	{
+		char *view = MapFileCopy(other.pageFile, maxSpace, pageFile);
+		if (view != NULL)
+		{
+			copyOnWrite = true;
+			if (written)
+				CopyWrittenPages(other.memory, view, maxSpace);
+			return view;
+		}
 	}
 
-	mbPtr->isUsed = true;
-	return mbPtr->startPtr;
+	char *copy = MapFilePages(maxSpace, pageFile);
+	if (copy != NULL)
+		memcpy(copy, other.memory, maxSpace);
+	return copy;
 }
 
-// - Deallocates memory
-void MemManage::Free(void* ptr)
+// - Hands the pages of the unused tail of a page backed arena back to the
+//   OS. The mapping always ends on a page boundary so a partial last page
+//   goes too. Discarded pages read as null so nothing past them needs
+//   lazily zeroing either.
+void MemManage::trimTail(char *tail)
 {
-    MemoryBlock *mb = memoryBlocks.search(FindMemoryBlockByPtr, ptr);
-    if (mb == NULL)
-        return;
+	if (options.backend != ARENA_PAGES)
+		return;
 
-    char *startPtr = (char*)mb->startPtr;
-    for (int i = 0; i < mb->size; i++)
-        *startPtr++ = '\0'; // null out the memory
+	size_t page = PageSize();
+	size_t first = ((size_t)(tail - memory) + page - 1) & ~(page - 1);
+	size_t end = ((size_t)maxSpace + page - 1) & ~(page - 1);
+	if (first >= end)
+		return;
 
-    freeSpace += mb->size;
-	mb->isUsed = false;
+	DiscardPages(memory + first, end - first);
+	if (untouched > memory + first)
+		untouched = memory + first;
 }
 
-// - Enlarges the allocated size
-void* MemManage::Realloc(void* ptr, int newSize)
+// - Maps a block size to its size class bin
+int MemManage::SizeClass(size_t size)
 {
-	MemoryBlock *mb = memoryBlocks.search(FindMemoryBlockByPtr, ptr);
+	if (size < SMALL_CLASSES)
+		return (int)size;
 
-	// Pointer must exist in memory blocks and new size cannot exceed free space
-	if (mb == NULL
-		|| mb->size < newSize && freeSpace < newSize - mb->size)
-		return NULL;
+	int power = HighestBit64(size);
+	int subClass = (int)(size >> (power - 2)) & (CLASSES_PER_POWER - 1);
+	return SMALL_CLASSES + (power - 4) * CLASSES_PER_POWER + subClass;
+}
 
-	// Case: new size is the same as old size
-	if (mb->size == newSize)
-		return mb->startPtr;
-	
-	// Case: new size is smaller than old size
-	if (newSize < mb->size)
+// - Empties every size class bin
+void MemManage::resetFreeBins()
+{
+	for (int i = 0; i < NUM_SIZE_CLASSES; i++)
+		freeBins[i] = BlockTable::NONE;
+	for (int i = 0; i < BIN_MAP_WORDS; i++)
+		binMap[i] = 0;
+	freeBlockCount = 0;
+	freeBySize.clear();
+}
+
+// - Address of a block's memory
+char* MemManage::blockStart(int block) const
+{
+	return memory + blocks.offset[block];
+}
+
+// - Pushes an unused block onto the front of its size class bin
+void MemManage::insertFreeBlock(int block)
+{
+	int bin = SizeClass(blocks.size[block]);
+	blocks.prevFree[block] = BlockTable::NONE;
+	blocks.nextFree[block] = freeBins[bin];
+	if (freeBins[bin] != BlockTable::NONE)
+		blocks.prevFree[freeBins[bin]] = block;
+	freeBins[bin] = block;
+	binMap[bin / 32] |= 1u << (bin % 32);
+	freeBlockCount++;
+	if (options.placement == PLACE_BEST_FIT || options.placement == PLACE_WORST_FIT)
+		freeBySize.insert(make_pair(blocks.size[block], block));
+}
+
+// - Unlinks an unused block from its size class bin
+void MemManage::removeFreeBlock(int block)
+{
+	int bin = SizeClass(blocks.size[block]);
+	int prev = blocks.prevFree[block];
+	int next = blocks.nextFree[block];
+	if (prev != BlockTable::NONE)
+		blocks.nextFree[prev] = next;
+	else
+		freeBins[bin] = next;
+	if (next != BlockTable::NONE)
+		blocks.prevFree[next] = prev;
+	if (freeBins[bin] == BlockTable::NONE)
+		binMap[bin / 32] &= ~(1u << (bin % 32));
+	blocks.prevFree[block] = blocks.nextFree[block] = BlockTable::NONE;
+	freeBlockCount--;
+	if (options.placement == PLACE_BEST_FIT || options.placement == PLACE_WORST_FIT)
+		freeBySize.erase(make_pair(blocks.size[block], block));
+}
+
+// - Finds an unused block of at least size bytes where the placement policy
+//   says, counting the blocks looked at on the way
+int MemManage::findFreeBlock(size_t size)
+{
+	searchSteps = 0;
+	int block = searchFreeBlock(size);
+	searchLengths[StatsBucket(searchSteps)]++;
+	return block;
+}
+
+// - Does the search for findFreeBlock. Under PLACE_SEGREGATED any block in
+//   a higher bin is guaranteed to fit so only the request's own bin ever
+//   needs searching.
+int MemManage::searchFreeBlock(size_t size)
+{
+	switch (options.placement)
 	{
-		// New smaller unused block
-		MemoryBlock unusedMb;
-		unusedMb.size = mb->size - newSize;
-		unusedMb.startPtr = mb->startPtr + newSize;
-		unusedMb.isUsed = false;
-		memoryBlocks.insertAfter(FindMemoryBlock, *mb, unusedMb);
+	case PLACE_FIRST_FIT:
+		return findFirstFit(blocks.First(), BlockTable::NONE, size);
 
-		// Resize block
-		mb->size = newSize;
-		freeSpace += unusedMb.size;
-		return mb->startPtr;
+	case PLACE_NEXT_FIT:
+	{
+		int start = rover != BlockTable::NONE ? rover : blocks.First();
+		int block = findFirstFit(start, BlockTable::NONE, size);
+		if (block == BlockTable::NONE)
+			block = findFirstFit(blocks.First(), start, size);
+		if (block != BlockTable::NONE)
+			rover = block;
+		return block;
 	}
 
-	// Case: new size is larger than old size
-	// Sub Case: current block is the last block
-	LinkedList<MemoryBlock>::iterator it = memoryBlocks.end();
-	if ((*it).startPtr == mb->startPtr)
+	case PLACE_BEST_FIT:
 	{
-		// just extend it
-		freeSpace -= newSize - mb->size;
-		mb->size = newSize;
-		return mb->startPtr;
+		set<pair<size_t, int> >::iterator it = freeBySize.lower_bound(make_pair(size, INT_MIN));
+		if (it == freeBySize.end())
+			return BlockTable::NONE;
+		searchSteps++;
+		return it->second;
 	}
 
-	it = memoryBlocks.begin();
-	while (it++ != memoryBlocks.end())
+	case PLACE_WORST_FIT:
+		if (freeBySize.empty() || freeBySize.rbegin()->first < size)
+			return BlockTable::NONE;
+		searchSteps++;
+		return freeBySize.rbegin()->second;
+
+	default:
+		break;
+	}
+
+	int bin = SizeClass(size);
+	if (freeBins[bin] != BlockTable::NONE)
+	{
+		searchSteps++;
+		if (blocks.size[freeBins[bin]] >= size)
+			return freeBins[bin];
+	}
+
+	// Lowest non-empty bin above the request's bin
+	for (int word = (bin + 1) / 32; word < BIN_MAP_WORDS; word++)
 	{
-		// find the current memory block in the list
-		if ((*it).startPtr == mb->startPtr)
+		unsigned int bits = binMap[word];
+		if (word == (bin + 1) / 32)
+			bits &= ~0u << ((bin + 1) % 32);
+		if (bits != 0)
 		{
-			MemoryBlock *nextBlock = &it.next();
-			// Sub Case: next block is unused and large enough
-			if (!nextBlock->isUsed && nextBlock->size > newSize - mb->size)
-			{
-				nextBlock->startPtr += newSize - mb->size;
-				nextBlock->size = mb->size + nextBlock->size - newSize;
-				freeSpace -= newSize - mb->size;
-				mb->size = newSize;
-				return mb->startPtr;
-			}
-			else // Not fitting the memory where it is, move memory to new space 
-			{
-				char *ptr = (char*)Alloc(newSize);
-				for (int i = 0; i < mb->size; i++)
-					ptr[i] = (mb->startPtr)[i];
-				Free(mb->startPtr);
-				return ptr;
-			}
+			searchSteps++;
+			return freeBins[word * 32 + LowestBit(bits)];
 		}
 	}
 
-	return NULL;
+	// Fall back to first fit within the rest of the request's own bin
+	if (freeBins[bin] == BlockTable::NONE)
+		return BlockTable::NONE;
+	for (int block = blocks.nextFree[freeBins[bin]]; block != BlockTable::NONE; block = blocks.nextFree[block])
+	{
+		searchSteps++;
+		if (blocks.size[block] >= size)
+			return block;
+	}
+	return BlockTable::NONE;
 }
 
-// - Eliminates memory fragmentation
-void MemManage::Compact()
+// - Walks the blocks in address order from one block up to but not
+//   including another, returning the first unused one of at least size bytes
+int MemManage::findFirstFit(int from, int to, size_t size)
 {
-	int offset = 0;
-	LinkedList<MemoryBlock>::iterator it = memoryBlocks.begin();
-	do
+	for (int block = from; block != to; block = blocks.nextBlock[block])
+	{
+		searchSteps++;
+		if (!blocks.IsUsed(block) && blocks.size[block] >= size)
+			return block;
+	}
+	return BlockTable::NONE;
+}
+
+// - Cuts a block down to size, returning the rest as a new block physically
+//   following it
+int MemManage::splitBlock(int block, size_t size)
+{
+	int remainder = blocks.InsertAfter(block, blocks.offset[block] + size, blocks.size[block] - size);
+	blocks.size[block] = size;
+	return remainder;
+}
+
+// - Absorbs the block physically following this one
+void MemManage::mergeWithNext(int block)
+{
+	int next = blocks.nextBlock[block];
+	if (compactCursor == next)
+		compactCursor = block;
+	if (rover == next)
+		rover = block;
+
+	blocks.size[block] += blocks.size[next];
+	blocks.Remove(next);
+}
+
+// - Bins a newly unused block, first merging it with unused neighbours so
+//   no two unused blocks are ever adjacent
+void MemManage::releaseBlock(int block)
+{
+	int next = blocks.nextBlock[block];
+	if (next != BlockTable::NONE && !blocks.IsUsed(next))
+	{
+		removeFreeBlock(next);
+		mergeWithNext(block);
+	}
+
+	int prev = blocks.prevBlock[block];
+	if (prev != BlockTable::NONE && !blocks.IsUsed(prev))
+	{
+		removeFreeBlock(prev);
+		mergeWithNext(prev);
+		block = prev;
+	}
+
+	insertFreeBlock(block);
+}
+
+// - Looks up the used block starting at ptr, or NONE if ptr was not
+//   returned by this memory manager
+int MemManage::findUsedBlock(void *ptr)
+{
+	char *charPtr = (char*)ptr;
+	if (charPtr < memory || charPtr >= memory + maxSpace)
+		return BlockTable::NONE;
+
+	unordered_map<size_t, int>::iterator it = usedBlocks.find((size_t)(charPtr - memory));
+	return it == usedBlocks.end() ? BlockTable::NONE : it->second;
+}
+
+// - Looks up the relocation table entry of a live handle
+MemManage::HandleEntry* MemManage::findHandle(MemHandle handle)
+{
+	if (handle <= 0 || handle > (int)handles.size() || handles[handle - 1].block == BlockTable::NONE)
+		return NULL;
+	return &handles[handle - 1];
+}
+
+// - Returns the handle owning a block, if any, for reuse
+void MemManage::releaseHandle(int block)
+{
+	MemHandle handle = blocks.handle[block];
+	if (handle == 0)
+		return;
+
+	HandleEntry &entry = handles[handle - 1];
+	entry.block = BlockTable::NONE;
+	entry.pinCount = 0;
+	freeHandles.push_back(handle);
+	blocks.handle[block] = 0;
+}
+
+// - Rebuilds the bins, offset index and handle table after the block
+//   records have been replaced
+void MemManage::rebuildIndexes()
+{
+	resetFreeBins();
+	usedBlocks.clear();
+	compactCursor = BlockTable::NONE;
+	rover = BlockTable::NONE;
+	for (int block = blocks.First(); block != BlockTable::NONE; block = blocks.nextBlock[block])
 	{
-		if (!(*it).isUsed)
-		{	
-			// Unused space needs to be removed
-			offset += (*it).size;
-			memoryBlocks.deleteNode(FindMemoryBlockByPtr, &(*it));
+		if (blocks.IsUsed(block))
+		{
+			usedBlocks[blocks.offset[block]] = block;
+			if (blocks.handle[block] != 0)
+				handles[blocks.handle[block] - 1].block = block;
 		}
-		else if (offset > 0)
+		else
+			insertFreeBlock(block);
+	}
+}
+
+// - Takes a used block of exactly size bytes from the free blocks, starting
+//   at an offset into memory that plus skew is a multiple of alignment
+int MemManage::allocBlock(size_t size, size_t alignment, size_t skew)
+{
+	// Requested size must not be more than available
+    if (size == 0 || size > freeSpace)
+        return BlockTable::NONE;
+
+    // Find unallocated space large enough to fit wherever its aligned start
+	// is. Blocks in the request's own bin that happen to have room for their
+	// padding are used up first rather than cutting into a larger block.
+	int block = BlockTable::NONE;
+	if (alignment > 1)
+	{
+		for (int candidate = freeBins[SizeClass(size)]; candidate != BlockTable::NONE; candidate = blocks.nextFree[candidate])
 		{
-			// Used space needs to be moved down (but only if offset is not 0)
-			(*it).startPtr -= offset;
-			for (int i = 0; i < (*it).size; i++)
+			size_t pad = (alignment - (blocks.offset[candidate] + skew) % alignment) % alignment;
+			if (blocks.size[candidate] >= size + pad)
 			{
-				(*it).startPtr[i] = (*it).startPtr[i + offset];
-				(*it).startPtr[i + offset] = '\0';
+				block = candidate;
+				break;
 			}
 		}
-	} while (it++ != memoryBlocks.end());
+	}
+	if (block == BlockTable::NONE)
+		block = findFreeBlock(size + alignment - 1);
+	if (block == BlockTable::NONE)
+		return BlockTable::NONE;
+	removeFreeBlock(block);
+
+	// Space in front of the aligned start stays unused
+	size_t pad = (alignment - (blocks.offset[block] + skew) % alignment) % alignment;
+	if (pad > 0)
+	{
+		int aligned = splitBlock(block, pad);
+		insertFreeBlock(block);
+		block = aligned;
+	}
+
+	// Found space was larger than needed split it up
+	if (blocks.size[block] > size)
+		insertFreeBlock(splitBlock(block, size));
+
+	freeSpace -= size;
+	blocks.SetUsed(block, true);
+	usedBlocks[blocks.offset[block]] = block;
+	return block;
 }
 
-// - Returns the amount of free memory
-int MemManage::Avail()
+// - Returns a pointer to allocated memory
+void* MemManage::Alloc(size_t size)
 {
-    return freeSpace;
+	unique_lock<mutex> traceLock = lockTrace();
+	unsigned long long start = OpStart();
+	void *ptr = allocMemory(size);
+	countOps(OP_ALLOC, size, 1, ptr == NULL && size > 0, start);
+	if (trace != NULL)
+		trace->Alloc(ptr, size);
+	return ptr;
 }
 
-// - Returns the total amount of memory usable by this memory manager
-int MemManage::Total()
+// - Alloc without recording the call, growing into chunks where allowed
+void* MemManage::allocMemory(size_t size)
 {
-	return maxSpace;
+	void *ptr = allocInArena(size);
+	if (ptr == NULL && options.growable && size > 0)
+		ptr = growAlloc(size, 1);
+	return ptr;
 }
 
-// - Prints raw memory content out - byte by byte as consecutive rows of
-//   16 hexadecimal values with a single space between them
-ostream& operator<<(ostream& os, MemManage const& mem)
+// - Returns a pointer to allocated memory at a multiple of alignment
+void* MemManage::AllocAligned(size_t size, size_t alignment)
 {
-    os << hex << uppercase << setfill('0');
-    for (int i = 0; i < mem.maxSpace; i++)
-    {
-        os << setw(2) << (unsigned(mem.memory[i]) & 0xFF);
+	if (alignment == 0)
+		alignment = size >= 64 ? 64 : size >= 32 ? 32 : 16;
+	if (size == 0 || (alignment & (alignment - 1)) != 0)
+		return NULL;
 
-        if ((i+1) % 16 == 0)
-            os << endl;
-        else if (i != mem.maxSpace - 1)
-            os << " ";
-    }
+	unique_lock<mutex> traceLock = lockTrace();
+	unsigned long long start = OpStart();
+	void *ptr = allocAlignedInArena(size, alignment);
+	if (ptr == NULL && options.growable)
+		ptr = growAlloc(size, alignment);
+	countOps(OP_ALLOC, size, 1, ptr == NULL, start);
+	if (trace != NULL)
+		trace->Alloc(ptr, size);
+	return ptr;
+}
 
-    return os;
+// - Returns a pointer to aligned memory from this heap's own arena. Aligned
+//   blocks always come from the central heap as span objects are packed.
+void* MemManage::allocAlignedInArena(size_t size, size_t alignment)
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	size_t skew = (size_t)memory % alignment;
+	if (options.allocator == ALLOCATOR_REGION)
+	{
+		// The padding is skipped over and comes back with the next reset
+		size_t pad = (alignment - (regionTop + skew) % alignment) % alignment;
+		if (pad >= freeSpace)
+			return NULL;
+		regionTop += pad;
+		freeSpace -= pad;
+		void *ptr = regionAlloc(size);
+		if (ptr == NULL)
+		{
+			regionTop -= pad;
+			freeSpace += pad;
+		}
+		return ptr;
+	}
+	if (options.allocator == ALLOCATOR_BUDDY)
+	{
+		// Blocks start on a multiple of their size into memory, so with
+		// memory itself aligned a block of alignment bytes or more will do.
+		// Otherwise the block is handed out from its first aligned byte.
+		if (skew == 0)
+			return buddyAlloc(size < alignment ? alignment : size);
+		if (size > maxSpace)
+			return NULL;
+		char *ptr = (char*)buddyAlloc(size + alignment - 1);
+		if (ptr == NULL)
+			return NULL;
+		return ptr + (alignment - (size_t)ptr % alignment) % alignment;
+	}
+
+	int block = allocBlock(size, alignment, skew);
+	if (block == BlockTable::NONE)
+		return NULL;
+	zeroAllocated(blockStart(block), size);
+	return blockStart(block);
 }
 
-// Prints the memory to stdout
-void MemManage::Dump()
+// - Returns a pointer to memory allocated from this heap's own arena
+void* MemManage::allocInArena(size_t size)
 {
-    cout << *this;
+	if (options.allocator == ALLOCATOR_REGION)
+		return regionAlloc(size);
+	if (options.allocator == ALLOCATOR_BUDDY)
+		return buddyAlloc(size);
+	if (size > 0 && SizeClass(size) < spanClasses)
+	{
+		void *ptr = cacheAlloc(size);
+		if (ptr != NULL)
+			return ptr;
+	}
+
+	unique_lock<recursive_mutex> lock = lockHeap();
+	int block = allocBlock(size);
+	if (block == BlockTable::NONE)
+		return NULL;
+
+	zeroAllocated(blockStart(block), size);
+	return blockStart(block);
+}
+
+// - Deallocates memory. The call is recorded first so the address cannot
+//   be handed out again before the trace forgets it.
+void MemManage::Free(void* ptr)
+{
+	unique_lock<mutex> traceLock = lockTrace();
+	if (trace != NULL)
+		trace->Free(ptr);
+	unsigned long long start = OpStart();
+	freeMemory(ptr);
+	countOps(OP_FREE, 0, 1, 0, start);
+}
+
+// - Free without recording the call
+void MemManage::freeMemory(void *ptr)
+{
+	if (options.growable && (ptr < memory || ptr >= memory + maxSpace))
+	{
+		MemManage *chunk = findChunk(ptr);
+		if (chunk != NULL)
+			chunk->freeMemory(ptr);
+		return;
+	}
+	if (options.allocator == ALLOCATOR_REGION)
+		return;
+	if (options.allocator == ALLOCATOR_BUDDY)
+	{
+		buddyFree(ptr);
+		return;
+	}
+	if (spanClasses > 0)
+	{
+		Span *span = findSpan(ptr);
+		if (span != NULL)
+		{
+			cacheFree(span, (char*)ptr);
+			return;
+		}
+	}
+
+	unique_lock<recursive_mutex> lock = lockHeap();
+	freeBlock(findUsedBlock(ptr));
+}
+
+// - Returns a used block to the free blocks, ignoring NONE
+void MemManage::freeBlock(int block)
+{
+    if (block == BlockTable::NONE)
+        return;
+
+    zeroFreed(blockStart(block), blocks.size[block]);
+    freeSpace += blocks.size[block];
+	blocks.SetUsed(block, false);
+	blocks.SetFixed(block, false);
+	usedBlocks.erase(blocks.offset[block]);
+	releaseHandle(block);
+	releaseBlock(block);
+}
+
+// - Allocates count blocks of size bytes into out
+size_t MemManage::AllocBatch(size_t size, size_t count, void **out)
+{
+	// Blocks the batch path does not cover, and whatever it runs out of
+	// room for, go through Alloc one at a time
+	unique_lock<mutex> traceLock = lockTrace();
+	unsigned long long start = OpStart();
+	size_t done = 0;
+	if (options.allocator == ALLOCATOR_FREE_LIST && size > 0 && SizeClass(size) >= spanClasses)
+		done = allocBlockBatch(size, count, out);
+	for (; done < count; done++)
+	{
+		out[done] = allocMemory(size);
+		if (out[done] == NULL)
+			break;
+	}
+
+	size_t allocated = done;
+	countOps(OP_ALLOC, size, count, size > 0 ? count - allocated : 0, start);
+	for (size_t i = 0; trace != NULL && i < allocated; i++)
+		trace->Alloc(out[i], size);
+	for (; done < count; done++)
+		out[done] = NULL;
+	return allocated;
+}
+
+// - Carves up to count used blocks of size bytes out of as few free blocks
+//   as possible, ideally one found by a single search. Returns how many it
+//   took.
+size_t MemManage::allocBlockBatch(size_t size, size_t count, void **out)
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	usedBlocks.reserve(usedBlocks.size() + count);
+	size_t done = 0;
+	while (done < count)
+	{
+		size_t remaining = count - done;
+		if (remaining > freeSpace / size)
+			remaining = freeSpace / size;
+		if (remaining == 0)
+			break;
+
+		int block = findFreeBlock(size * remaining);
+		if (block == BlockTable::NONE)
+			block = findFreeBlock(size);
+		if (block == BlockTable::NONE)
+			break;
+		removeFreeBlock(block);
+
+		size_t pieces = blocks.size[block] / size;
+		if (pieces > remaining)
+			pieces = remaining;
+		zeroAllocated(blockStart(block), pieces * size);
+		freeSpace -= pieces * size;
+		for (size_t i = 0; i < pieces; i++)
+		{
+			int rest = blocks.size[block] > size ? splitBlock(block, size) : BlockTable::NONE;
+			blocks.SetUsed(block, true);
+			usedBlocks[blocks.offset[block]] = block;
+			out[done++] = blockStart(block);
+			block = rest;
+		}
+		if (block != BlockTable::NONE)
+			insertFreeBlock(block);
+	}
+	return done;
+}
+
+// - Deallocates count pointers
+void MemManage::FreeBatch(void **ptrs, size_t count)
+{
+	unique_lock<mutex> traceLock = lockTrace();
+	for (size_t i = 0; trace != NULL && i < count; i++)
+		trace->Free(ptrs[i]);
+	unsigned long long start = OpStart();
+	if (options.allocator != ALLOCATOR_FREE_LIST)
+	{
+		for (size_t i = 0; i < count; i++)
+			freeMemory(ptrs[i]);
+		countOps(OP_FREE, 0, count, 0, start);
+		return;
+	}
+
+	unique_lock<recursive_mutex> lock = lockHeap();
+	vector<int> batch;
+	batch.reserve(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		int block = findUsedBlock(ptrs[i]);
+		if (block != BlockTable::NONE && !blocks.IsFixed(block))
+			batch.push_back(block);
+		else
+			freeMemory(ptrs[i]);
+	}
+	freeBlockBatch(batch);
+	countOps(OP_FREE, 0, count, 0, start);
+}
+
+// - Returns used blocks to the free blocks. Runs of physically neighbouring
+//   blocks are merged while still used, so each run is nulled, merged with
+//   its free neighbours and binned once.
+void MemManage::freeBlockBatch(vector<int> &batch)
+{
+	sort(batch.begin(), batch.end(), [this](int a, int b) { return blocks.offset[a] < blocks.offset[b]; });
+	batch.erase(unique(batch.begin(), batch.end()), batch.end());
+
+	for (size_t i = 0; i < batch.size(); i++)
+	{
+		int first = batch[i];
+		while (true)
+		{
+			int block = batch[i];
+			usedBlocks.erase(blocks.offset[block]);
+			releaseHandle(block);
+			blocks.SetUsed(block, false);
+			if (block != first)
+				mergeWithNext(first);
+			if (i + 1 == batch.size() || blocks.nextBlock[first] != batch[i + 1])
+				break;
+			i++;
+		}
+
+		zeroFreed(blockStart(first), blocks.size[first]);
+		freeSpace += blocks.size[first];
+		releaseBlock(first);
+	}
+}
+
+// - Enlarges the allocated size. The old block may be freed before the
+//   call is recorded, so the trace lock keeps other threads from being
+//   handed it and recording that first.
+void* MemManage::Realloc(void* ptr, size_t newSize)
+{
+	unique_lock<mutex> traceLock = lockTrace();
+	unsigned long long start = OpStart();
+	void *newPtr = reallocMemory(ptr, newSize);
+	countOps(OP_REALLOC, newSize, 1, newPtr == NULL && newSize > 0, start);
+	if (trace != NULL)
+		trace->Realloc(ptr, newPtr, newSize);
+	return newPtr;
+}
+
+// - Realloc without recording the call
+void* MemManage::reallocMemory(void *ptr, size_t newSize)
+{
+	if (!options.growable)
+		return reallocInArena(ptr, newSize);
+
+	// Memory that cannot grow where it is may move to any chunk
+	MemManage *owner = findChunk(ptr);
+	if (owner == NULL)
+		return NULL;
+	void *newPtr = owner->reallocInArena(ptr, newSize);
+	if (newPtr != NULL || newSize == 0)
+		return newPtr;
+
+	// Handle memory has to stay in the first arena
+	if (owner == this)
+	{
+		unique_lock<recursive_mutex> lock = lockHeap();
+		int block = findUsedBlock(ptr);
+		if (block != BlockTable::NONE && blocks.handle[block] != 0)
+			return NULL;
+	}
+
+	size_t oldSize = owner->allocatedSize(ptr);
+	if (oldSize == 0 || (newPtr = allocMemory(newSize)) == NULL)
+		return NULL;
+	copyBlockData((char*)newPtr, (char*)ptr, oldSize < newSize ? oldSize : newSize);
+	owner->freeMemory(ptr);
+	return newPtr;
+}
+
+// - Resizes memory allocated from this heap's own arena
+void* MemManage::reallocInArena(void* ptr, size_t newSize)
+{
+	if (options.allocator == ALLOCATOR_REGION)
+		return regionRealloc(ptr, newSize);
+	if (options.allocator == ALLOCATOR_BUDDY)
+		return buddyRealloc(ptr, newSize);
+
+	// Span objects can grow up to the size of their class in place, past
+	// that they move to a new allocation. Objects do not record the size
+	// asked for, so everything past newSize is nulled as the zero policy
+	// has it, whether given up by shrinking or yet to be grown into. That
+	// keeps an object null past its size, so a move copying the whole
+	// object brings nothing over past the live part.
+	Span *span = spanClasses > 0 ? findSpan(ptr) : NULL;
+	if (span != NULL)
+	{
+		if (newSize == 0)
+			return NULL;
+		if (newSize <= span->objectSize)
+		{
+			zeroFreed((char*)ptr + newSize, span->objectSize - newSize);
+			zeroAllocated((char*)ptr + newSize, span->objectSize - newSize);
+			return ptr;
+		}
+
+		void *newPtr = allocMemory(newSize);
+		if (newPtr == NULL)
+			return NULL;
+		copyBlockData((char*)newPtr, (char*)ptr, span->objectSize);
+		freeMemory(ptr);
+		return newPtr;
+	}
+
+	unique_lock<recursive_mutex> lock = lockHeap();
+	int block = findUsedBlock(ptr);
+
+	// Pointer must exist in memory blocks and new size cannot exceed free space
+	if (block == BlockTable::NONE || newSize == 0
+		|| (blocks.size[block] < newSize && freeSpace < newSize - blocks.size[block]))
+		return NULL;
+
+	size_t oldSize = blocks.size[block];
+	char *start = blockStart(block);
+
+	// Case: new size is the same as old size
+	if (oldSize == newSize)
+		return start;
+	
+	// Case: new size is smaller than old size
+	if (newSize < oldSize)
+	{
+		// New smaller unused block
+		freeSpace += oldSize - newSize;
+		zeroFreed(start + newSize, oldSize - newSize);
+		releaseBlock(splitBlock(block, newSize));
+		return start;
+	}
+
+	// Case: new size is larger than old size
+	// Sub Case: next block is unused and larger than needed
+	size_t growth = newSize - oldSize;
+	int nextBlock = blocks.nextBlock[block];
+	size_t nextFree = nextBlock != BlockTable::NONE && !blocks.IsUsed(nextBlock) ? blocks.size[nextBlock] : 0;
+	if (nextFree > growth)
+	{
+		removeFreeBlock(nextBlock);
+		blocks.offset[nextBlock] += growth;
+		blocks.size[nextBlock] -= growth;
+		insertFreeBlock(nextBlock);
+		freeSpace -= growth;
+		zeroAllocated(start + oldSize, growth);
+		blocks.size[block] = newSize;
+		return start;
+	}
+
+	// Sub Case: next block is unused and exactly fits, absorb it whole
+	if (nextFree == growth)
+	{
+		removeFreeBlock(nextBlock);
+		mergeWithNext(block);
+		freeSpace -= growth;
+		zeroAllocated(start + oldSize, growth);
+		return start;
+	}
+
+	// Sub Case: unused blocks either side are large enough together. The
+	// block takes both over and its memory slides down to the start of the
+	// previous one, which beats moving it anywhere else. Pinned memory stays.
+	int prevBlock = blocks.prevBlock[block];
+	size_t prevFree = prevBlock != BlockTable::NONE && !blocks.IsUsed(prevBlock) ? blocks.size[prevBlock] : 0;
+	if (prevFree > 0 && prevFree + nextFree >= growth
+		&& !blocks.IsFixed(block) && (blocks.handle[block] == 0 || isMovable(block)))
+	{
+		if (nextFree > 0)
+		{
+			removeFreeBlock(nextBlock);
+			mergeWithNext(block);
+		}
+		removeFreeBlock(prevBlock);
+		usedBlocks.erase(blocks.offset[block]);
+		blocks.offset[block] = blocks.offset[prevBlock];
+		blocks.size[block] += prevFree;
+		if (compactCursor == prevBlock)
+			compactCursor = block;
+		if (rover == prevBlock)
+			rover = block;
+		blocks.Remove(prevBlock);
+		usedBlocks[blocks.offset[block]] = block;
+
+		char *newStart = blockStart(block);
+		moveBlockData(newStart, start, oldSize);
+		zeroAllocated(newStart + oldSize, growth);
+		freeSpace -= growth;
+		if (blocks.size[block] > newSize)
+			releaseBlock(splitBlock(block, newSize));
+		return newStart;
+	}
+
+	// Not fitting the memory where it is, move memory to new space 
+	int newBlock = allocBlock(newSize);
+	if (newBlock == BlockTable::NONE)
+		return NULL;
+	zeroAllocated(blockStart(newBlock) + oldSize, newSize - oldSize);
+	copyBlockData(blockStart(newBlock), start, oldSize);
+
+	// Any owning handle follows the memory to its new block
+	MemHandle handle = blocks.handle[block];
+	blocks.handle[newBlock] = handle;
+	if (handle != 0)
+		handles[handle - 1].block = newBlock;
+	blocks.handle[block] = 0;
+
+	freeBlock(block);
+	return blockStart(newBlock);
+}
+
+// - Alloc under ALLOCATOR_BUDDY. The whole block is zeroed where the policy
+//   asks as Realloc may later grow into the rest of it.
+void* MemManage::buddyAlloc(size_t size)
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	SharedGuard guard(*this);
+	size_t offset = buddy.Alloc(size);
+	if (offset == BuddyAllocator::NO_BLOCK)
+		return NULL;
+
+	size_t blockSize = buddy.BlockSize(offset);
+	freeSpace -= blockSize;
+	zeroAllocated(memory + offset, blockSize);
+	return memory + offset;
+}
+
+// - Offset of the allocated buddy block holding ptr, or NO_BLOCK if there is
+//   none. AllocAligned can hand blocks out from part way in.
+size_t MemManage::buddyBlockOf(void *ptr)
+{
+	if (ptr < memory || ptr >= memory + maxSpace)
+		return BuddyAllocator::NO_BLOCK;
+	return buddy.BlockStart((char*)ptr - memory);
+}
+
+// - Free under ALLOCATOR_BUDDY, ignoring pointers to no allocated block
+void MemManage::buddyFree(void *ptr)
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	SharedGuard guard(*this);
+	size_t offset = buddyBlockOf(ptr);
+	if (offset == BuddyAllocator::NO_BLOCK)
+		return;
+
+	size_t blockSize = buddy.BlockSize(offset);
+
+	zeroFreed(memory + offset, blockSize);
+	freeSpace += blockSize;
+	buddy.Free(offset);
+}
+
+// - Realloc under ALLOCATOR_BUDDY. Blocks grow in place up to the end of
+//   their power of two block and move past it, to the start of a new one.
+void* MemManage::buddyRealloc(void *ptr, size_t newSize)
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	SharedGuard guard(*this);
+	size_t offset = buddyBlockOf(ptr);
+	if (offset == BuddyAllocator::NO_BLOCK || newSize == 0)
+		return NULL;
+
+	size_t oldSize = memory + offset + buddy.BlockSize(offset) - (char*)ptr;
+	if (newSize <= oldSize)
+		return ptr;
+
+	void *newPtr = buddyAlloc(newSize);
+	if (newPtr == NULL)
+		return NULL;
+	copyBlockData((char*)newPtr, (char*)ptr, oldSize);
+	buddyFree(ptr);
+	return newPtr;
+}
+
+// - Alloc under ALLOCATOR_REGION, the top just moves up past the allocation
+void* MemManage::regionAlloc(size_t size)
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	if (size == 0 || size > freeSpace)
+		return NULL;
+
+	char *start = memory + regionTop;
+	regionLast = regionTop;
+	regionTop += size;
+	freeSpace -= size;
+	zeroAllocated(start, size);
+	return start;
+}
+
+// - Realloc under ALLOCATOR_REGION. Nothing records the size of older
+//   allocations so only the latest one can be resized, in place.
+void* MemManage::regionRealloc(void *ptr, size_t newSize)
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	if (ptr != memory + regionLast || newSize == 0 || newSize > maxSpace - regionLast)
+		return NULL;
+
+	size_t newTop = regionLast + newSize;
+	if (newTop > regionTop)
+		zeroAllocated(memory + regionTop, newTop - regionTop);
+	else
+		zeroFreed(memory + newTop, regionTop - newTop);
+	regionTop = newTop;
+	freeSpace = maxSpace - regionTop;
+	return ptr;
+}
+
+// - Returns the top of a region heap. Allocations from before the mark
+//   can no longer be resized, growing one would take memory past the mark
+//   that ResetTo then hands out again.
+RegionMark MemManage::Mark()
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	regionLast = maxSpace;
+	return regionTop;
+}
+
+// - Releases everything allocated from a region heap since mark was taken
+void MemManage::ResetTo(RegionMark mark)
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	if (options.allocator != ALLOCATOR_REGION || mark > regionTop)
+		return;
+
+	zeroFreed(memory + mark, regionTop - mark);
+	regionTop = mark;
+	regionLast = maxSpace;
+	freeSpace = maxSpace - regionTop;
+}
+
+// - Releases everything allocated from a region heap
+void MemManage::Reset()
+{
+	ResetTo(0);
+}
+
+// - Returns a handle to allocated memory that Compact may relocate
+MemHandle MemManage::AllocHandle(size_t size)
+{
+	// Handle memory always comes from the central heap as spans never move
+	unique_lock<recursive_mutex> lock = lockHeap();
+	if (options.allocator != ALLOCATOR_FREE_LIST)
+		return 0;
+	int block = allocBlock(size);
+	if (block == BlockTable::NONE)
+		return 0;
+	zeroAllocated(blockStart(block), size);
+
+	MemHandle handle;
+	if (!freeHandles.empty())
+	{
+		handle = freeHandles.back();
+		freeHandles.pop_back();
+	}
+	else
+	{
+		HandleEntry entry = { BlockTable::NONE, 0 };
+		handles.push_back(entry);
+		handle = (MemHandle)handles.size();
+	}
+
+	blocks.handle[block] = handle;
+	handles[handle - 1].block = block;
+	return handle;
+}
+
+// - Deallocates memory owned by a handle
+void MemManage::FreeHandle(MemHandle handle)
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	HandleEntry *entry = findHandle(handle);
+	if (entry != NULL)
+		freeBlock(entry->block);
+}
+
+// - Returns the current address of a handle's memory
+void* MemManage::Resolve(MemHandle handle)
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	HandleEntry *entry = findHandle(handle);
+	return entry == NULL ? NULL : blockStart(entry->block);
+}
+
+// - Stops Compact moving a handle's memory and returns its address
+void* MemManage::Pin(MemHandle handle)
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	HandleEntry *entry = findHandle(handle);
+	if (entry == NULL)
+		return NULL;
+
+	entry->pinCount++;
+	return blockStart(entry->block);
+}
+
+// - Allows Compact to move a handle's memory again
+void MemManage::Unpin(MemHandle handle)
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	HandleEntry *entry = findHandle(handle);
+	if (entry != NULL && entry->pinCount > 0)
+		entry->pinCount--;
+}
+
+// - Whether a block belongs to an unpinned handle, so may be moved while
+//   clients hold on to their handles
+bool MemManage::isMovable(int block)
+{
+	MemHandle handle = blocks.handle[block];
+	return blocks.IsUsed(block) && handle != 0 && handles[handle - 1].pinCount == 0;
+}
+
+// - Moves a block's contents down to a lower address, nulling out the
+//   memory it vacates under ZERO_ON_FREE
+void MemManage::moveBlockData(char *dest, char *src, size_t size)
+{
+	if (dest + size <= src)
+	{
+		copyBlockData(dest, src, size);
+		zeroFreed(src, size);
+	}
+	else
+	{
+		memmove(dest, src, size);
+		zeroFreed(dest + size, (size_t)(src - dest));
+	}
+}
+
+// - Copies between non-overlapping blocks. Copies too large to be worth
+//   caching use non-temporal stores so they don't evict the working set.
+void MemManage::copyBlockData(char *dest, char const *src, size_t size)
+{
+#ifdef MEMMANAGE_SSE2
+	if (size >= NON_TEMPORAL_THRESHOLD)
+	{
+		// Bring dest up to 16 byte alignment for the streaming stores
+		size_t head = (16 - ((size_t)dest & 15)) & 15;
+		memcpy(dest, src, head);
+		dest += head;
+		src += head;
+		size -= head;
+
+		size_t chunks = size / 64;
+		for (size_t i = 0; i < chunks; i++, dest += 64, src += 64)
+		{
+			__m128i a = _mm_loadu_si128((__m128i const*)src);
+			__m128i b = _mm_loadu_si128((__m128i const*)(src + 16));
+			__m128i c = _mm_loadu_si128((__m128i const*)(src + 32));
+			__m128i d = _mm_loadu_si128((__m128i const*)(src + 48));
+			_mm_stream_si128((__m128i*)dest, a);
+			_mm_stream_si128((__m128i*)(dest + 16), b);
+			_mm_stream_si128((__m128i*)(dest + 32), c);
+			_mm_stream_si128((__m128i*)(dest + 48), d);
+		}
+		_mm_sfence();
+		size -= chunks * 64;
+	}
+#endif
+	memcpy(dest, src, size);
+}
+
+// - Nulls out memory that is no longer in use under ZERO_ON_FREE
+void MemManage::zeroFreed(char *start, size_t size)
+{
+	if (options.zeroPolicy == ZERO_ON_FREE && size > 0)
+		memset(start, 0, size);
+}
+
+// - Nulls out memory being handed out under ZERO_ON_ALLOC and ZERO_LAZY.
+//   Lazily zeroed memory past anything handed out before is still null
+//   from calloc so only the part below that needs it. Page backed arenas
+//   commit everything up to the end of it the first time it is handed out.
+void MemManage::zeroAllocated(char *start, size_t size)
+{
+	char *end = start + size;
+	if (options.backend == ARENA_PAGES && end > untouched)
+		CommitPages(untouched, end - untouched);
+	if (options.zeroPolicy == ZERO_ON_ALLOC)
+		memset(start, 0, size);
+	else if (options.zeroPolicy == ZERO_LAZY && start < untouched)
+		memset(start, 0, (end < untouched ? end : untouched) - start);
+
+	if (end > untouched)
+		untouched = end;
+}
+
+// - Serialises calls while they are being recorded, otherwise does nothing
+unique_lock<mutex> MemManage::lockTrace()
+{
+	if (trace == NULL)
+		return unique_lock<mutex>();
+	return unique_lock<mutex>(traceMutex);
+}
+
+// - Locks the central heap in thread safe mode, otherwise does nothing
+unique_lock<recursive_mutex> MemManage::lockHeap() const
+{
+	if (!options.threadSafe)
+		return unique_lock<recursive_mutex>();
+	return unique_lock<recursive_mutex>(heapMutex);
+}
+
+// - Largest size belonging to a size class
+size_t MemManage::ClassMaxSize(int sizeClass)
+{
+	if (sizeClass < SMALL_CLASSES)
+		return sizeClass;
+
+	int power = (sizeClass - SMALL_CLASSES) / CLASSES_PER_POWER + 4;
+	int subClass = (sizeClass - SMALL_CLASSES) % CLASSES_PER_POWER;
+	return ((size_t)1 << power) + ((size_t)(subClass + 1) << (power - 2)) - 1;
+}
+
+// - Returns the calling thread's cache, creating it on first use
+MemManage::ThreadCache* MemManage::threadCache()
+{
+	if (lastHeapId == heapId)
+		return (ThreadCache*)lastHeapCache;
+
+	unique_lock<recursive_mutex> lock = lockHeap();
+	thread::id self = this_thread::get_id();
+	ThreadCache *cache = NULL;
+	for (size_t i = 0; i < caches.size() && cache == NULL; i++)
+	{
+		if (caches[i]->thread == self)
+			cache = caches[i];
+	}
+	if (cache == NULL)
+	{
+		cache = new ThreadCache;
+		cache->thread = self;
+		for (int i = 0; i < CACHED_CLASSES; i++)
+			cache->spans[i] = NULL;
+		caches.push_back(cache);
+	}
+
+	lastHeapId = heapId;
+	lastHeapCache = cache;
+	return cache;
+}
+
+// - Looks up the span an object was handed out from, or NULL if ptr is not
+//   an object in any span. Spans fill whole SPAN_SIZE slots of memory so no
+//   other block can share a slot with one.
+MemManage::Span* MemManage::findSpan(void *ptr)
+{
+	char *charPtr = (char*)ptr;
+	if (charPtr < memory || charPtr >= memory + maxSpace)
+		return NULL;
+
+	size_t slot = (size_t)(charPtr - memory) / SPAN_SIZE;
+	Span *span = slot < spanMap.size() ? spanMap[slot] : NULL;
+	if (span == NULL)
+		return NULL;
+
+	size_t offset = (size_t)(charPtr - span->start);
+	if (offset % span->objectSize != 0 || offset / span->objectSize >= span->capacity)
+		return NULL;
+	return span;
+}
+
+// - Hands out an object from the calling thread's spans, or NULL if there is
+//   no room left in the arena for another span
+void* MemManage::cacheAlloc(size_t size)
+{
+	int sizeClass = SizeClass(size < MIN_OBJECT ? MIN_OBJECT : size);
+	ThreadCache *cache = threadCache();
+
+	// Look for room in the thread's spans of this class, reclaiming objects
+	// freed by other threads along the way
+	Span *span = cache->spans[sizeClass];
+	while (span != NULL)
+	{
+		if (span->freeList == NO_OBJECT)
+			collectRemoteFrees(span);
+		if (span->freeList != NO_OBJECT || span->carved < span->capacity)
+			break;
+		span = span->next;
+	}
+
+	if (span == NULL)
+	{
+		span = refillCache(cache, sizeClass);
+		if (span == NULL)
+			return NULL;
+	}
+	else if (span != cache->spans[sizeClass])
+	{
+		// Allocate from this span from now on, the first one is full
+		unlinkSpan(cache->spans[sizeClass], span);
+		linkSpan(cache->spans[sizeClass], span);
+	}
+
+	char *ptr;
+	if (span->freeList != NO_OBJECT)
+	{
+		// Reused objects hold a free list link and maybe old contents
+		ptr = span->start + span->freeList * span->objectSize;
+		memcpy(&span->freeList, ptr, sizeof(span->freeList));
+		if (options.zeroPolicy == ZERO_ON_ALLOC || options.zeroPolicy == ZERO_LAZY)
+			memset(ptr, 0, span->objectSize);
+		else if (options.zeroPolicy == ZERO_ON_FREE)
+			memset(ptr, 0, sizeof(span->freeList));
+	}
+	else
+	{
+		// Never handed out before so still null from when the span was carved
+		ptr = span->start + span->carved * span->objectSize;
+		span->carved++;
+	}
+	unsigned int index = (unsigned int)((size_t)(ptr - span->start) / span->objectSize);
+	span->usedBits[index / 32].fetch_or(1u << (index % 32), memory_order_relaxed);
+	span->used++;
+	return ptr;
+}
+
+// - Returns an object to its span. Only the owning thread touches the span's
+//   own free list, any other thread pushes onto its remote free queue.
+//   Abandoned spans are only ever touched under the heap lock. Objects
+//   not handed out, or already freed, are ignored.
+void MemManage::cacheFree(Span *span, char *ptr)
+{
+	unsigned int index = (unsigned int)((size_t)(ptr - span->start) / span->objectSize);
+	unsigned int bit = 1u << (index % 32);
+	if ((span->usedBits[index / 32].fetch_and(~bit, memory_order_relaxed) & bit) == 0)
+		return;
+
+	zeroFreed(ptr, span->objectSize);
+	ThreadCache *owner = span->owner.load(memory_order_acquire);
+	if (owner == NULL)
+	{
+		unique_lock<recursive_mutex> lock = lockHeap();
+		owner = span->owner.load(memory_order_acquire);
+		if (owner == NULL)
+		{
+			memcpy(ptr, &span->freeList, sizeof(span->freeList));
+			span->freeList = index;
+			span->used--;
+			collectRemoteFrees(span);
+			if (span->used == 0)
+			{
+				unlinkSpan(abandonedSpans[span->sizeClass], span);
+				releaseSpan(span);
+			}
+			return;
+		}
+	}
+
+	if (lastHeapId != heapId || lastHeapCache != owner)
+	{
+		unsigned int head = span->remoteFrees.load(memory_order_relaxed);
+		do
+			memcpy(ptr, &head, sizeof(head));
+		while (!span->remoteFrees.compare_exchange_weak(head, index, memory_order_release, memory_order_relaxed));
+		return;
+	}
+
+	memcpy(ptr, &span->freeList, sizeof(span->freeList));
+	span->freeList = index;
+	span->used--;
+
+	// The first span of a class is kept for the next allocation, any other
+	// goes back to the central heap as soon as it is empty
+	if (span->used == 0 && owner->spans[span->sizeClass] != span)
+	{
+		unlinkSpan(owner->spans[span->sizeClass], span);
+		releaseSpan(span);
+	}
+}
+
+// - Gives a thread a span of a size class with room in it, adopting any
+//   abandoned ones first and otherwise carving a new one out of the central
+//   heap. A whole span's worth of objects comes from one trip to the heap.
+MemManage::Span* MemManage::refillCache(ThreadCache *cache, int sizeClass)
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	while (abandonedSpans[sizeClass] != NULL)
+	{
+		Span *span = abandonedSpans[sizeClass];
+		unlinkSpan(abandonedSpans[sizeClass], span);
+		span->owner.store(cache, memory_order_release);
+		collectRemoteFrees(span);
+		linkSpan(cache->spans[sizeClass], span);
+		if (span->freeList != NO_OBJECT || span->carved < span->capacity)
+			return span;
+	}
+
+	int block = allocBlock(SPAN_SIZE, SPAN_SIZE);
+	if (block == BlockTable::NONE)
+		return NULL;
+	blocks.SetFixed(block, true);
+	zeroAllocated(blockStart(block), SPAN_SIZE);
+
+	Span *span = new Span;
+	span->start = blockStart(block);
+	span->objectSize = ClassMaxSize(sizeClass);
+	span->sizeClass = sizeClass;
+	span->capacity = (unsigned int)(SPAN_SIZE / span->objectSize);
+	span->carved = 0;
+	span->used = 0;
+	span->freeList = NO_OBJECT;
+	span->remoteFrees.store(NO_OBJECT);
+	span->usedBits = new atomic<unsigned int>[(span->capacity + 31) / 32]();
+	span->owner.store(cache);
+	spanMap[(size_t)(span->start - memory) / SPAN_SIZE] = span;
+	linkSpan(cache->spans[sizeClass], span);
+	return span;
+}
+
+// - Moves objects freed by other threads onto the span's own free list
+void MemManage::collectRemoteFrees(Span *span)
+{
+	if (span->remoteFrees.load(memory_order_relaxed) == NO_OBJECT)
+		return;
+
+	unsigned int index = span->remoteFrees.exchange(NO_OBJECT, memory_order_acquire);
+	while (index != NO_OBJECT)
+	{
+		char *ptr = span->start + index * span->objectSize;
+		unsigned int next;
+		memcpy(&next, ptr, sizeof(next));
+		memcpy(ptr, &span->freeList, sizeof(span->freeList));
+		span->freeList = index;
+		span->used--;
+		index = next;
+	}
+}
+
+// - Pushes a span onto the front of a list of spans
+void MemManage::linkSpan(Span *&first, Span *span)
+{
+	span->prev = NULL;
+	span->next = first;
+	if (first != NULL)
+		first->prev = span;
+	first = span;
+}
+
+// - Unlinks a span from a list of spans
+void MemManage::unlinkSpan(Span *&first, Span *span)
+{
+	if (span->prev != NULL)
+		span->prev->next = span->next;
+	else
+		first = span->next;
+	if (span->next != NULL)
+		span->next->prev = span->prev;
+	span->prev = span->next = NULL;
+}
+
+// - Returns an empty span's memory to the central heap
+void MemManage::releaseSpan(Span *span)
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	spanMap[(size_t)(span->start - memory) / SPAN_SIZE] = NULL;
+	freeBlock(findUsedBlock(span->start));
+	delete[] span->usedBits;
+	delete span;
+}
+
+// - Records calls to writer from now on, or stops recording if it is NULL
+void MemManage::SetTrace(TraceWriter *writer)
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	trace = writer;
+}
+
+// - Makes ptr the allocation a file or shared heap leads to when opened
+void MemManage::SetRoot(void *ptr)
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	SharedGuard guard(*this);
+	if (fileHeader != NULL)
+		fileHeader->root = ptr == NULL ? NO_ROOT : (size_t)((char*)ptr - memory);
+}
+
+// - Returns the root allocation of a file or shared heap
+void* MemManage::Root()
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	SharedGuard guard(*this);
+	if (fileHeader == NULL || fileHeader->root == NO_ROOT)
+		return NULL;
+	return memory + fileHeader->root;
+}
+
+// - Writes what an ARENA_FILE heap has changed out to its file
+void MemManage::Sync()
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	if (fileHeader == NULL)
+		return;
+	SyncPages((char*)fileHeader, fileHeader->fileBytes);
+}
+
+// - Returns ptr's offset into the arena
+size_t MemManage::Offset(void *ptr)
+{
+	if (ptr < memory || ptr >= memory + maxSpace)
+		return NO_OFFSET;
+	return (char*)ptr - memory;
+}
+
+// - Returns the memory at an offset into the arena
+void* MemManage::Address(size_t offset)
+{
+	return offset < maxSpace ? memory + offset : NULL;
+}
+
+// - Removes the name of an ARENA_SHARED heap's segment
+void MemManage::Unlink(char const *path)
+{
+	UnlinkSharedMemory(path);
+}
+
+// - Hands the calling thread's spans back to the heap. Empty ones are freed,
+//   the rest are abandoned for other threads to adopt.
+void MemManage::ReleaseThreadCache()
+{
+	if (!options.threadSafe)
+		return;
+
+	ThreadCache *cache = threadCache();
+	unique_lock<recursive_mutex> lock = lockHeap();
+	for (size_t i = 0; i < chunks.size(); i++)
+		chunks[i]->ReleaseThreadCache();
+	for (int i = 0; i < CACHED_CLASSES; i++)
+	{
+		while (cache->spans[i] != NULL)
+		{
+			Span *span = cache->spans[i];
+			unlinkSpan(cache->spans[i], span);
+			span->owner.store(NULL, memory_order_release);
+			collectRemoteFrees(span);
+			if (span->used == 0)
+				releaseSpan(span);
+			else
+				linkSpan(abandonedSpans[i], span);
+		}
+	}
+}
+
+// - Gives a copy its own records of another heap's spans. They all start
+//   out abandoned, to be adopted by the next thread needing their class.
+void MemManage::copySpans(MemManage const &other)
+{
+	for (int i = 0; i < CACHED_CLASSES; i++)
+		abandonedSpans[i] = NULL;
+	spanMap.assign(other.spanMap.size(), (Span*)NULL);
+	for (size_t slot = 0; slot < spanMap.size(); slot++)
+	{
+		Span const *from = other.spanMap[slot];
+		if (from == NULL)
+			continue;
+
+		Span *span = new Span;
+		span->start = memory + (from->start - other.memory);
+		span->objectSize = from->objectSize;
+		span->sizeClass = from->sizeClass;
+		span->capacity = from->capacity;
+		span->carved = from->carved;
+		span->used = from->used;
+		span->freeList = from->freeList;
+		span->remoteFrees.store(from->remoteFrees.load());
+		span->usedBits = new atomic<unsigned int>[(span->capacity + 31) / 32];
+		for (unsigned int word = 0; word < (span->capacity + 31) / 32; word++)
+			span->usedBits[word].store(from->usedBits[word].load());
+		span->owner.store(NULL);
+		spanMap[slot] = span;
+		linkSpan(abandonedSpans[span->sizeClass], span);
+	}
+}
+
+// - Deletes every span record and thread cache
+void MemManage::destroySpans()
+{
+	for (size_t slot = 0; slot < spanMap.size(); slot++)
+	{
+		if (spanMap[slot] != NULL)
+			delete[] spanMap[slot]->usedBits;
+		delete spanMap[slot];
+	}
+	spanMap.clear();
+	for (size_t i = 0; i < caches.size(); i++)
+		delete caches[i];
+	caches.clear();
+	for (int i = 0; i < CACHED_CLASSES; i++)
+		abandonedSpans[i] = NULL;
+}
+
+// - Size of the allocation at ptr in this heap's own arena, 0 if there is
+//   none or its size is not recorded
+size_t MemManage::allocatedSize(void *ptr)
+{
+	Span *span = spanClasses > 0 ? findSpan(ptr) : NULL;
+	if (span != NULL)
+		return span->objectSize;
+
+	unique_lock<recursive_mutex> lock = lockHeap();
+	if (options.allocator == ALLOCATOR_BUDDY)
+	{
+		size_t offset = buddyBlockOf(ptr);
+		if (offset == BuddyAllocator::NO_BLOCK)
+			return 0;
+		return memory + offset + buddy.BlockSize(offset) - (char*)ptr;
+	}
+	int block = findUsedBlock(ptr);
+	return block == BlockTable::NONE ? 0 : blocks.size[block];
+}
+
+// - Returns the heap owning ptr, this one or one of its chunks, or NULL if
+//   ptr is in none of them
+MemManage* MemManage::findChunk(void *ptr)
+{
+	if (ptr >= memory && ptr < memory + maxSpace)
+		return this;
+
+	unique_lock<recursive_mutex> lock = lockHeap();
+	map<char*, MemManage*>::iterator it = chunksByAddress.upper_bound((char*)ptr);
+	if (it == chunksByAddress.begin())
+		return NULL;
+	--it;
+	MemManage *chunk = it->second;
+	return ptr < chunk->memory + chunk->maxSpace ? chunk : NULL;
+}
+
+// - Serves an allocation the arena has no room for from its chunks, newest
+//   and largest first, adding a chunk twice the size of the last when none
+//   has room. Alignments above 1 go through AllocAligned. Chunks live until
+//   the heap does.
+void* MemManage::growAlloc(size_t size, size_t alignment)
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	if (options.allocator == ALLOCATOR_REGION)
+		return NULL;
+	for (size_t i = chunks.size(); i-- > 0;)
+	{
+		void *ptr = alignment > 1 ? chunks[i]->AllocAligned(size, alignment) : chunks[i]->Alloc(size);
+		if (ptr != NULL)
+			return ptr;
+	}
+
+	size_t needed = size + alignment - 1;
+	size_t chunkSize = (chunks.empty() ? maxSpace : chunks.back()->maxSpace) * 2;
+	if (chunkSize < needed * 2)
+		chunkSize = needed * 2;
+	if (needed < size || chunkSize / 2 < needed)
+		return NULL;
+
+	MemManageOptions chunkOptions = options;
+	chunkOptions.growable = false;
+	MemManage *chunk = new MemManage(chunkSize, chunkOptions);
+	if (chunk->memory == NULL)
+	{
+		delete chunk;
+		return NULL;
+	}
+	chunks.push_back(chunk);
+	chunksByAddress[chunk->memory] = chunk;
+	return alignment > 1 ? chunk->AllocAligned(size, alignment) : chunk->Alloc(size);
+}
+
+// - Gives a copy its own copies of another heap's chunks
+void MemManage::copyChunks(MemManage const &other)
+{
+	chunks.clear();
+	chunksByAddress.clear();
+	for (size_t i = 0; i < other.chunks.size(); i++)
+	{
+		MemManage *chunk = new MemManage(*other.chunks[i]);
+		chunks.push_back(chunk);
+		chunksByAddress[chunk->memory] = chunk;
+	}
+}
+
+// - Deletes every chunk
+void MemManage::destroyChunks()
+{
+	for (size_t i = 0; i < chunks.size(); i++)
+		delete chunks[i];
+	chunks.clear();
+	chunksByAddress.clear();
+}
+
+// - Eliminates memory fragmentation
+void MemManage::Compact()
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	for (size_t i = 0; i < chunks.size(); i++)
+		chunks[i]->Compact();
+	if (blocks.Count() == 0)
+		return;
+
+	// Used blocks are slid down in address order, unused ones dropped. A
+	// pinned or fixed block stays put and the gap left in front of it stays
+	// unused.
+	// Runs of adjacent blocks moving by the same offset are moved together.
+	// The records are rebuilt in a fresh table so rows end up in address
+	// order, making later walks over the table sequential.
+	spareBlocks.Clear();
+	size_t nextOffset = 0;
+	size_t runSrc = 0, runDest = 0, runSize = 0;
+	for (int block = blocks.First(); block != BlockTable::NONE; block = blocks.nextBlock[block])
+	{
+		if (!blocks.IsUsed(block))
+			continue;
+
+		size_t offset = blocks.offset[block];
+		size_t size = blocks.size[block];
+		if (blocks.IsFixed(block) || (blocks.handle[block] != 0 && !isMovable(block)))
+		{
+			if (nextOffset < offset)
+				spareBlocks.Append(nextOffset, offset - nextOffset);
+		}
+		else if (nextOffset < offset)
+		{
+			// Used space needs to be moved down (but only if offset is not 0)
+			if (runSize > 0 && runSrc + runSize == offset)
+				runSize += size;
+			else
+			{
+				if (runSize > 0)
+					moveBlockData(memory + runDest, memory + runSrc, runSize);
+				runSrc = offset;
+				runDest = nextOffset;
+				runSize = size;
+			}
+			offset = nextOffset;
+		}
+
+		int moved = spareBlocks.Append(offset, size);
+		spareBlocks.SetUsed(moved, true);
+		spareBlocks.SetFixed(moved, blocks.IsFixed(block));
+		spareBlocks.handle[moved] = blocks.handle[block];
+		nextOffset = offset + size;
+	}
+	if (runSize > 0)
+		moveBlockData(memory + runDest, memory + runSrc, runSize);
+
+	// All the remaining unused space is now a single block at the end
+	if (nextOffset < maxSpace)
+	{
+		spareBlocks.Append(nextOffset, maxSpace - nextOffset);
+		trimTail(memory + nextOffset);
+	}
+	blocks.Swap(spareBlocks);
+	rebuildIndexes();
+}
+
+// - Moves up to maxBytes of handle memory down into free space
+bool MemManage::CompactStep(size_t maxBytes)
+{
+	// Rough cost of looking at a block record, so long runs with nothing to
+	// move still end the step
+	const size_t VISIT_COST = 16;
+
+	unique_lock<recursive_mutex> lock = lockHeap();
+	int block = compactCursor;
+	if (block == BlockTable::NONE)
+		block = blocks.First();
+
+	size_t spent = 0;
+	bool moved = false;
+	while (block != BlockTable::NONE && spent < maxBytes)
+	{
+		int next = blocks.nextBlock[block];
+		if (blocks.IsUsed(block) || next == BlockTable::NONE || !isMovable(next))
+		{
+			spent += VISIT_COST;
+			block = next;
+			continue;
+		}
+
+		// A block larger than the rest of the budget waits for the next
+		// step, but every step moves at least one block
+		size_t usedSize = blocks.size[next];
+		if (moved && usedSize > maxBytes - spent)
+			break;
+
+		// Slide the handle's memory to the start of the free block. The two
+		// records swap roles so the physical chain keeps its order.
+		removeFreeBlock(block);
+		size_t freeSize = blocks.size[block];
+		size_t dest = blocks.offset[block];
+		moveBlockData(memory + dest, blockStart(next), usedSize);
+		spent += usedSize;
+		moved = true;
+
+		usedBlocks.erase(blocks.offset[next]);
+		blocks.size[block] = usedSize;
+		blocks.SetUsed(block, true);
+		blocks.handle[block] = blocks.handle[next];
+		handles[blocks.handle[block] - 1].block = block;
+		usedBlocks[dest] = block;
+
+		blocks.size[next] = freeSize;
+		blocks.offset[next] = dest + usedSize;
+		blocks.SetUsed(next, false);
+		blocks.handle[next] = 0;
+
+		// Merging with a following unused block may delete the record after
+		// next, never next itself
+		releaseBlock(next);
+		block = next;
+	}
+
+	compactCursor = block;
+	return block == BlockTable::NONE;
+}
+
+// - Returns the amount of free memory
+size_t MemManage::Avail()
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	SharedGuard guard(*this);
+	size_t avail = freeSpace;
+	for (size_t i = 0; i < chunks.size(); i++)
+		avail += chunks[i]->Avail();
+    return avail;
+}
+
+// - Returns the total amount of memory usable by this memory manager
+size_t MemManage::Total()
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	size_t total = maxSpace;
+	for (size_t i = 0; i < chunks.size(); i++)
+		total += chunks[i]->maxSpace;
+	return total;
+}
+
+// - Returns the size of the largest free block
+size_t MemManage::LargestFree()
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	SharedGuard guard(*this);
+	size_t largest = largestFreeInArena();
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		size_t chunkLargest = chunks[i]->LargestFree();
+		if (chunkLargest > largest)
+			largest = chunkLargest;
+	}
+	return largest;
+}
+
+// - Returns the size of the largest free block in this heap's own arena.
+//   Only the highest non-empty bin can hold it.
+size_t MemManage::largestFreeInArena()
+{
+	if (options.allocator == ALLOCATOR_BUDDY)
+		return buddy.LargestFree();
+	if (options.allocator == ALLOCATOR_REGION)
+		return freeSpace;
+	for (int word = BIN_MAP_WORDS - 1; word >= 0; word--)
+	{
+		if (binMap[word] == 0)
+			continue;
+
+		size_t largest = 0;
+		int bin = word * 32 + HighestBit(binMap[word]);
+		for (int block = freeBins[bin]; block != BlockTable::NONE; block = blocks.nextFree[block])
+		{
+			if (blocks.size[block] > largest)
+				largest = blocks.size[block];
+		}
+		return largest;
+	}
+	return 0;
+}
+
+// - Returns the fraction of free memory unusable by a single allocation,
+//   0 when all free memory is one block and approaching 1 as it splinters
+double MemManage::Fragmentation()
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	size_t avail = Avail();
+	if (avail == 0)
+		return 0.0;
+	return 1.0 - (double)LargestFree() / (double)avail;
+}
+
+// - Adds calls to the counters of the calling thread, or of the heap unless
+//   it is thread safe, timing them from start if they were sampled. A
+//   batch's slowest call is taken to be its average.
+void MemManage::countOps(MemOp op, size_t size, size_t calls, size_t failed, unsigned long long start)
+{
+	OpCounters &counts = options.threadSafe ? threadCache()->counters : counters;
+	counts.calls[op] += calls;
+	counts.failed += failed;
+	if (op != OP_FREE)
+		counts.allocSizes[StatsBucket(size)] += calls;
+	if (start == 0 || calls == 0)
+		return;
+
+	unsigned long long elapsed = OpClock() - start;
+	counts.timedCalls[op] += calls;
+	counts.latencyNs[op] += elapsed;
+	if (elapsed / calls > counts.maxLatencyNs[op])
+		counts.maxLatencyNs[op] = elapsed / calls;
+}
+
+// - Adds the block counts and free space of this heap's own arena to stats
+void MemManage::addArenaStats(MemStats &stats)
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	SharedGuard guard(*this);
+	stats.totalBytes += maxSpace;
+	stats.freeBytes += freeSpace;
+	size_t largest = largestFreeInArena();
+	if (largest > stats.largestFree)
+		stats.largestFree = largest;
+	for (int i = 0; i < STATS_BUCKETS; i++)
+		stats.searchLengths[i] += searchLengths[i];
+
+	if (options.allocator == ALLOCATOR_BUDDY)
+	{
+		stats.liveBlocks += buddy.UsedBlocks();
+		stats.freeBlocks += buddy.FreeBlocks();
+	}
+	else if (options.allocator == ALLOCATOR_REGION)
+		stats.freeBlocks += freeSpace > 0 ? 1 : 0;
+	else
+	{
+		// A span is one used block holding many objects, which are counted
+		// in its place. Spans stay in their block with no objects left.
+		stats.liveBlocks += usedBlocks.size();
+		stats.freeBlocks += freeBlockCount;
+		for (size_t slot = 0; slot < spanMap.size(); slot++)
+		{
+			if (spanMap[slot] != NULL)
+			{
+				stats.liveBlocks += spanMap[slot]->used;
+				stats.liveBlocks--;
+			}
+		}
+	}
+}
+
+// - Returns a snapshot of the heap. In thread safe mode the counters of
+//   calls other threads are part way through may be caught mid update.
+MemStats MemManage::Stats()
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	MemStats stats;
+	stats.ops = counters;
+	for (size_t i = 0; i < caches.size(); i++)
+		stats.ops.Add(caches[i]->counters);
+	addArenaStats(stats);
+	for (size_t i = 0; i < chunks.size(); i++)
+		chunks[i]->addArenaStats(stats);
+	if (stats.freeBytes > 0)
+		stats.fragmentation = 1.0 - (double)stats.largestFree / (double)stats.freeBytes;
+	return stats;
+}
+
+// Two hexadecimal digits for every byte value
+static char const HEX_PAIRS[] =
+	"000102030405060708090A0B0C0D0E0F"
+	"101112131415161718191A1B1C1D1E1F"
+	"202122232425262728292A2B2C2D2E2F"
+	"303132333435363738393A3B3C3D3E3F"
+	"404142434445464748494A4B4C4D4E4F"
+	"505152535455565758595A5B5C5D5E5F"
+	"606162636465666768696A6B6C6D6E6F"
+	"707172737475767778797A7B7C7D7E7F"
+	"808182838485868788898A8B8C8D8E8F"
+	"909192939495969798999A9B9C9D9E9F"
+	"A0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+	"B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+	"C0C1C2C3C4C5C6C7C8C9CACBCCCDCECF"
+	"D0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+	"E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+	"F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+// Buffers dump output, handing it to a stream in large writes
+class DumpBuffer
+{
+private:
+	static const size_t SIZE = 64 << 10;
+	ostream &out;
+	vector<char> data;
+	size_t used;
+
+public:
+	DumpBuffer(ostream &os) : out(os), data(SIZE), used(0) {}
+	~DumpBuffer() { Flush(); }
+
+	// - Makes room for at least count more characters
+	char* Reserve(size_t count)
+	{
+		if (used + count > SIZE)
+			Flush();
+		return &data[used];
+	}
+
+	// - Marks count characters written since the last Reserve
+	void Commit(size_t count) { used += count; }
+
+	void Flush()
+	{
+		out.write(&data[0], used);
+		used = 0;
+	}
+};
+
+// - Writes value as digits hexadecimal digits, zero padded
+static char* WriteHexNumber(char *dest, unsigned long long value, int digits)
+{
+	for (int i = digits - 1; i >= 0; i--)
+	{
+		dest[i] = HEX_PAIRS[(value & 0xF) * 2 + 1];
+		value >>= 4;
+	}
+	return dest + digits;
+}
+
+// - Writes value in decimal
+static char* WriteDecimal(char *dest, unsigned long long value)
+{
+	char digits[20];
+	int count = 0;
+	do
+	{
+		digits[count++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value != 0);
+	while (count > 0)
+		*dest++ = digits[--count];
+	return dest;
+}
+
+// - Copies text without its terminator
+static char* WriteText(char *dest, char const *text)
+{
+	size_t len = strlen(text);
+	memcpy(dest, text, len);
+	return dest + len;
+}
+
+// - Hexadecimal digits needed for every offset into size bytes, at least 8
+static int OffsetDigits(size_t size)
+{
+	int digits = 8;
+	while (digits < 16 && (unsigned long long)size > (1ull << (digits * 4)))
+		digits++;
+	return digits;
+}
+
+// - Writes bytes from..to of memory as rows of 16 values with a single space
+//   between them, rows breaking at multiples of 16 bytes. With offsetDigits
+//   each row is led by its offset and every row ends a line, otherwise a
+//   last row short of 16 bytes is left unended.
+static void WriteHexRows(DumpBuffer &buffer, char const *memory, size_t from, size_t to, int offsetDigits)
+{
+	size_t row = from;
+	while (row < to)
+	{
+		size_t rowEnd = (row / 16 + 1) * 16;
+		if (rowEnd > to)
+			rowEnd = to;
+		char *start = buffer.Reserve(16 * 3 + 20);
+		char *dest = start;
+		if (offsetDigits > 0)
+		{
+			dest = WriteHexNumber(dest, row, offsetDigits);
+			*dest++ = ':';
+			*dest++ = ' ';
+		}
+		for (size_t i = row; i < rowEnd; i++)
+		{
+			char const *pair = HEX_PAIRS + ((unsigned char)memory[i] << 1);
+			dest[0] = pair[0];
+			dest[1] = pair[1];
+			dest[2] = ' ';
+			dest += 3;
+		}
+		if (offsetDigits > 0 || rowEnd % 16 == 0)
+			dest[-1] = '\n';
+		else
+			dest--;
+		buffer.Commit(dest - start);
+		row = rowEnd;
+	}
+}
+
+// - Prints raw memory content out - byte by byte as consecutive rows of
+//   16 hexadecimal values with a single space between them
+ostream& operator<<(ostream& os, MemManage const& mem)
+{
+	unique_lock<recursive_mutex> lock = mem.lockHeap();
+	{
+		DumpBuffer buffer(os);
+		WriteHexRows(buffer, mem.memory, 0, mem.maxSpace, 0);
+	}
+
+	// Each chunk starts on a line of its own
+	for (size_t i = 0; i < mem.chunks.size(); i++)
+	{
+		if (mem.maxSpace % 16 != 0)
+			os << endl;
+		os << *mem.chunks[i];
+	}
+    return os;
+}
+
+// Prints the memory to stdout
+void MemManage::Dump()
+{
+    cout << *this;
+}
+
+// - Writes a range of the arena to out
+void MemManage::Dump(size_t offset, size_t len, ostream &out, DumpMode mode)
+{
+	unique_lock<recursive_mutex> lock = lockHeap();
+	if (offset >= maxSpace)
+		return;
+	size_t end = len < maxSpace - offset ? offset + len : maxSpace;
+
+	if (mode == DUMP_RAW)
+		out.write(memory + offset, end - offset);
+	else if (mode == DUMP_BLOCKS && options.allocator == ALLOCATOR_FREE_LIST)
+		dumpBlocks(offset, end, out);
+	else
+	{
+		DumpBuffer buffer(out);
+		WriteHexRows(buffer, memory, offset, end, OffsetDigits(maxSpace));
+	}
+}
+
+// - Writes bytes offset..end as hex rows, breaking them at the start of each
+//   block to give its offset, size and state
+void MemManage::dumpBlocks(size_t offset, size_t end, ostream &out) const
+{
+	int digits = OffsetDigits(maxSpace);
+	DumpBuffer buffer(out);
+
+	int block = blocks.First();
+	while (block != BlockTable::NONE && blocks.offset[block] + blocks.size[block] <= offset)
+		block = blocks.nextBlock[block];
+	for (; block != BlockTable::NONE && blocks.offset[block] < end; block = blocks.nextBlock[block])
+	{
+		char *start = buffer.Reserve(128);
+		char *dest = start;
+		dest = WriteText(dest, "-- ");
+		dest = WriteHexNumber(dest, blocks.offset[block], digits);
+		dest = WriteText(dest, " ");
+		dest = WriteDecimal(dest, blocks.size[block]);
+		dest = WriteText(dest, blocks.IsUsed(block) ? " bytes used" : " bytes free");
+		int handle = blocks.handle[block];
+		if (handle != 0)
+		{
+			dest = WriteText(dest, ", handle ");
+			dest = WriteDecimal(dest, handle);
+			if (handles[handle - 1].pinCount > 0)
+				dest = WriteText(dest, ", pinned");
+		}
+		if (blocks.IsFixed(block))
+			dest = WriteText(dest, ", fixed");
+		*dest++ = '\n';
+		buffer.Commit(dest - start);
+
+		size_t from = blocks.offset[block] > offset ? blocks.offset[block] : offset;
+		size_t to = blocks.offset[block] + blocks.size[block];
+		WriteHexRows(buffer, memory, from, to < end ? to : end, digits);
+	}
 }
 
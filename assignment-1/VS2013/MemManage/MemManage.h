@@ -1,28 +1,276 @@
 #ifndef MEMMANAGE_H
 #define MEMMANAGE_H
 
+#include <atomic>
 #include <iostream>
-#include "..\DataStructures\LinkedList.h"
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "BlockTable.h"
+#include "BuddyAllocator.h"
+#include "MemStats.h"
+#include "MemTrace.h"
+#include "OffsetPtr.h"
+#include "PageArena.h"
 
-struct MemoryBlock
+// Relocatable allocation that survives Compact. 0 is never a valid handle.
+typedef int MemHandle;
+
+// Point in a region heap to release allocations back to
+typedef size_t RegionMark;
+
+// When a MemManage nulls out memory
+enum ZeroPolicy
+{
+	ZERO_NONE,					// Never, memory keeps whatever was last written to it
+	ZERO_ON_FREE,				// As it is freed or vacated by a move, so free memory is always null
+	ZERO_ON_ALLOC,				// As it is handed out
+	ZERO_LAZY					// As it is handed out, skipping memory never handed out before
+};
+
+// Where a MemManage gets its arena from
+enum ArenaBackend
+{
+	ARENA_HEAP,					// malloc, or calloc when memory has to start out null
+	ARENA_PAGES,				// Address space reserved from the OS, pages committed as they are handed out
+	ARENA_SNAPSHOT,				// Pages of an anonymous file that copies map copy-on-write, so only
+								// pages written afterwards are ever copied. Copies are full on Windows.
+	ARENA_FILE,					// The file named by path, shared with it so the heap outlives the
+								// process. Reopening the file maps the heap back as it was left, link
+								// its contents with OffsetPtr. Always ALLOCATOR_BUDDY and not growable,
+								// copies are ARENA_HEAP.
+	ARENA_SHARED				// The shared memory segment named by path, such as "/name" on POSIX.
+								// Every process opening it shares one heap behind a process lock, and
+								// finds the others' allocations by Offset and Address. As ARENA_FILE
+								// otherwise, lasting until Unlink or a reboot.
+};
+
+// How a MemManage carves up its arena
+enum BlockAllocator
+{
+	ALLOCATOR_FREE_LIST,		// Exactly sized blocks in segregated free lists, with handles and Compact
+	ALLOCATOR_BUDDY,			// Power of two blocks split and merged with their buddies. No handles,
+								// Compact does nothing and thread safe mode only locks.
+	ALLOCATOR_REGION			// Allocations bumped off the top of the arena and released all at once
+								// with ResetTo or Reset, Free does nothing. Otherwise as ALLOCATOR_BUDDY.
+};
+
+// Which free block ALLOCATOR_FREE_LIST carves an allocation from
+enum PlacementPolicy
+{
+	PLACE_SEGREGATED,			// Any block from the lowest size class bin sure to fit
+	PLACE_FIRST_FIT,			// The lowest addressed block that fits
+	PLACE_NEXT_FIT,				// The first block that fits after the last one used, wrapping around
+	PLACE_BEST_FIT,				// The smallest block that fits
+	PLACE_WORST_FIT				// The largest block
+};
+
+// How Dump writes out a range of memory
+enum DumpMode
 {
-    int	 size;
-	char *startPtr;
-	bool isUsed;
+	DUMP_HEX,					// Rows of 16 hexadecimal bytes, each led by its offset into the arena
+	DUMP_BLOCKS,				// As DUMP_HEX with a line before each block giving its size and state.
+								// Blocks are only known under ALLOCATOR_FREE_LIST.
+	DUMP_RAW					// The bytes themselves, in a single write
+};
+
+// Construction time settings for a MemManage
+struct MemManageOptions
+{
+	ZeroPolicy zeroPolicy;
+	ArenaBackend backend;
+	BlockAllocator allocator;
+	PlacementPolicy placement;
+	bool hugePages;				// Ask for huge pages under ARENA_PAGES where the OS supports it
+	bool threadSafe;			// Safe to share between threads, small blocks go through per thread caches
+	bool slabs;					// Size classes up to the one holding 256 bytes come from slabs of same
+								// sized objects, as classes up to 1 KB always do in thread safe mode
+	bool growable;				// Allocations the arena has no room for go to chunks chained after it,
+								// each twice the size of the last. Handles stay in the first arena.
+								// Not under ALLOCATOR_REGION.
+	char const *path;			// File or segment an ARENA_FILE or ARENA_SHARED heap lives in, created
+								// with max bytes of arena if missing
+
+	MemManageOptions() : zeroPolicy(ZERO_ON_FREE), backend(ARENA_HEAP), allocator(ALLOCATOR_FREE_LIST),
+		placement(PLACE_SEGREGATED), hugePages(false), threadSafe(false), slabs(false), growable(false),
+		path(NULL) { }
 };
 
 class MemManage
 {
 private:
-    int maxSpace;							// Total available memory
-    int freeSpace;							// Unused available memory
+	// Sizes below SMALL_CLASSES get an exact bin each, every power of two
+	// above that is split into CLASSES_PER_POWER bins
+	static const int SMALL_CLASSES = 16;
+	static const int CLASSES_PER_POWER = 4;
+	static const int SIZE_BITS = (int)sizeof(size_t) * 8;
+	static const int NUM_SIZE_CLASSES = SMALL_CLASSES + (SIZE_BITS - 1 - 4) * CLASSES_PER_POWER;
+	static const int BIN_MAP_WORDS = (NUM_SIZE_CLASSES + 31) / 32;
+
+	// Copies at least this large stream past the cache
+	static const size_t NON_TEMPORAL_THRESHOLD = 4 << 20;
+
+	// Arenas start on a multiple of this, enough for the widest vector loads
+	static const size_t ARENA_ALIGNMENT = 64;
+
+	// In thread safe mode size classes up to 1 KB are served from spans, runs
+	// of same sized objects owned by one thread, and with slabs on up to
+	// 256 bytes. Freed objects are linked through their first bytes by index
+	// so need at least MIN_OBJECT bytes.
+	static const int CACHED_CLASSES = SMALL_CLASSES + (10 - 4) * CLASSES_PER_POWER + 1;
+	static const int SLAB_CLASSES = SMALL_CLASSES + (8 - 4) * CLASSES_PER_POWER + 1;
+	static const size_t SPAN_SIZE = 64 << 10;
+	static const size_t MIN_OBJECT = sizeof(unsigned int);
+	static const unsigned int NO_OBJECT = ~0u;
+
+	struct ThreadCache;
+	struct Span
+	{
+		char *start;							// First object, SPAN_SIZE aligned within memory
+		size_t objectSize;
+		int sizeClass;
+		unsigned int capacity;					// Objects that fit in the span
+		unsigned int carved;					// Objects past this have never been handed out
+		unsigned int used;						// Objects handed out and not yet reclaimed
+		unsigned int freeList;					// Objects freed by the owning thread
+		std::atomic<unsigned int> remoteFrees;	// Objects freed by any other thread
+		std::atomic<unsigned int> *usedBits;	// One bit per object handed out and not yet freed
+		std::atomic<ThreadCache*> owner;		// NULL while abandoned
+		Span *prev, *next;						// Owner's spans of the same size class
+	};
+	struct ThreadCache
+	{
+		std::thread::id thread;
+		Span *spans[CACHED_CLASSES];			// Allocations come from the first span of a class
+		OpCounters counters;					// Calls the thread has made on the heap
+	};
+
+	MemManageOptions options;
+    size_t maxSpace;						// Total available memory
+    size_t freeSpace;						// Unused available memory
     char* memory;							// Internal memory storage
-    LinkedList<MemoryBlock> memoryBlocks;	// Data structure to record memory blocks
+	void* heapArena;						// What ARENA_HEAP got from malloc, memory is aligned up from it
+	PageFile pageFile;						// File or segment behind a file backed arena
+	struct FileHeader;
+	FileHeader *fileHeader;					// Start of an ARENA_FILE or ARENA_SHARED heap's memory
+	ProcessLock processLock;				// Held around changes to an ARENA_SHARED heap
+	struct SharedGuard;
+	mutable bool copyOnWrite;				// The arena is a private view of a file copies may share
+	char* untouched;						// Memory from here on has never been handed out
+    BlockTable blocks;						// Records of every block of memory
+	BlockTable spareBlocks;					// Storage Compact builds the next table in
+	int freeBins[NUM_SIZE_CLASSES];			// Unused blocks segregated by size class
+	size_t freeBlockCount;					// Unused blocks across all bins
+	unsigned int binMap[BIN_MAP_WORDS];		// One bit per non-empty bin
+	std::set<std::pair<size_t, int> > freeBySize;	// Unused blocks by size, under PLACE_BEST_FIT and PLACE_WORST_FIT
+	int rover;								// Where PLACE_NEXT_FIT resumes searching
+	std::unordered_map<size_t, int> usedBlocks;	// Used blocks keyed by offset into memory
+	BuddyAllocator buddy;					// Takes the place of the block records under ALLOCATOR_BUDDY
+	size_t regionTop;						// Offset of the next allocation under ALLOCATOR_REGION
+	size_t regionLast;						// Offset of the latest allocation, maxSpace if there is none
+
+	struct HandleEntry
+	{
+		int block;					// Current block, NONE while the handle is unused
+		int pinCount;				// Pinned blocks are never moved by Compact
+	};
+	std::vector<HandleEntry> handles;	// Relocation table, indexed by handle - 1
+	std::vector<MemHandle> freeHandles;	// Released handles available for reuse
+	int compactCursor;					// Where the next CompactStep resumes, NONE to start a new pass
+
+	int spanClasses;					// Size classes served from spans, 0 without any
+	unsigned int heapId;				// Never reused, tells apart heaps sharing an address over time
+	mutable std::recursive_mutex heapMutex;	// Guards everything but spans in thread safe mode
+	std::vector<Span*> spanMap;			// Span in each SPAN_SIZE slot of memory
+	std::vector<ThreadCache*> caches;	// One per thread that has used this heap
+	Span *abandonedSpans[CACHED_CLASSES];	// Spans no thread owns, waiting to be adopted
+
+	std::vector<MemManage*> chunks;		// Heaps grown into once the arena is full, oldest first
+	std::map<char*, MemManage*> chunksByAddress;	// The same keyed by arena start, to find a pointer's owner
+
+	TraceWriter *trace;					// Where calls are recorded, NULL when they are not
+	std::mutex traceMutex;				// Held across each recorded call, so the trace has them
+										// in the order the heap made them
+	OpCounters counters;				// Calls made on the heap, thread caches keep their own
+	unsigned long long searchLengths[STATS_BUCKETS];	// Histogram of blocks looked at by findFreeBlock
+	size_t searchSteps;					// Blocks looked at by the search under way
+
 	void copyMemManage(MemManage const &);
+	char* allocArena(size_t size);
+	char* shareArena(MemManage const &other);
+	char* openFile(size_t &size);
+	void freeArena();
+	void trimTail(char *tail);
+
+	static int SizeClass(size_t size);
+	void resetFreeBins();
+	char* blockStart(int block) const;
+	void insertFreeBlock(int block);
+	void removeFreeBlock(int block);
+	int findFreeBlock(size_t size);
+	int searchFreeBlock(size_t size);
+	int findFirstFit(int from, int to, size_t size);
+	int splitBlock(int block, size_t size);
+	void mergeWithNext(int block);
+	void releaseBlock(int block);
+	int findUsedBlock(void *ptr);
+	HandleEntry* findHandle(MemHandle);
+	void releaseHandle(int block);
+	bool isMovable(int block);
+	void moveBlockData(char *dest, char *src, size_t size);
+	static void copyBlockData(char *dest, char const *src, size_t size);
+	void zeroFreed(char *start, size_t size);
+	void zeroAllocated(char *start, size_t size);
+	int allocBlock(size_t size, size_t alignment = 1, size_t skew = 0);
+	size_t allocBlockBatch(size_t size, size_t count, void **out);
+	void freeBlock(int block);
+	void freeBlockBatch(std::vector<int> &batch);
+	void rebuildIndexes();
+	size_t buddyBlockOf(void *ptr);
+	void* buddyAlloc(size_t size);
+	void buddyFree(void *ptr);
+	void* buddyRealloc(void *ptr, size_t newSize);
+	void* regionAlloc(size_t size);
+	void* regionRealloc(void *ptr, size_t newSize);
+
+	std::unique_lock<std::recursive_mutex> lockHeap() const;
+	std::unique_lock<std::mutex> lockTrace();
+	static size_t ClassMaxSize(int sizeClass);
+	ThreadCache* threadCache();
+	Span* findSpan(void *ptr);
+	void* cacheAlloc(size_t size);
+	void cacheFree(Span *, char *ptr);
+	Span* refillCache(ThreadCache *, int sizeClass);
+	void collectRemoteFrees(Span *);
+	static void linkSpan(Span *&first, Span *);
+	static void unlinkSpan(Span *&first, Span *);
+	void releaseSpan(Span *);
+	void copySpans(MemManage const &);
+	void destroySpans();
+
+	void* allocMemory(size_t size);
+	void freeMemory(void *ptr);
+	void* reallocMemory(void *ptr, size_t newSize);
+	void* allocInArena(size_t size);
+	void* allocAlignedInArena(size_t size, size_t alignment);
+	void* reallocInArena(void *ptr, size_t newSize);
+	size_t largestFreeInArena();
+	size_t allocatedSize(void *ptr);
+	MemManage* findChunk(void *ptr);
+	void* growAlloc(size_t size, size_t alignment);
+	void copyChunks(MemManage const &);
+	void destroyChunks();
+	void countOps(MemOp op, size_t size, size_t calls, size_t failed, unsigned long long start);
+	void addArenaStats(MemStats &stats);
+	void dumpBlocks(size_t offset, size_t end, std::ostream &out) const;
 
 public:
     // - Creates initial memory array
-    MemManage(int max = 0);
+    MemManage(size_t max = 0);
+    MemManage(size_t max, MemManageOptions const&);
 
 	// - Copy Constructor
 	MemManage(MemManage const&);
@@ -31,25 +279,122 @@ public:
     ~MemManage();
 
     // - Returns a pointer to allocated memory
-    void* Alloc(int size);
+    void* Alloc(size_t size);
+
+    // - Returns a pointer to allocated memory at a multiple of alignment, a
+    //   power of two. 0 picks 16, 32 or 64 bytes by size, suiting the widest
+    //   vector loads the buffer can feed. Realloc keeps the alignment only
+    //   while the memory does not move.
+    void* AllocAligned(size_t size, size_t alignment = 0);
 
     // - Deallocates memory
     void Free(void*);
 
+    // - Allocates count blocks of size bytes into out, carved from as few
+    //   free blocks as possible. Returns how many were allocated, the rest
+    //   of out is set to NULL.
+    size_t AllocBatch(size_t size, size_t count, void **out);
+
+    // - Deallocates count pointers, merging runs of neighbouring blocks
+    //   before binning them once per run
+    void FreeBatch(void **ptrs, size_t count);
+
     // - Enlarges the allocated size
-    void* Realloc(void*, int);
+    void* Realloc(void*, size_t);
+
+    // - Returns the top of a region heap, for ResetTo to release everything
+    //   allocated after it. Only allocations made after it can be resized.
+    RegionMark Mark();
+
+    // - Releases everything allocated from a region heap since mark was
+    //   taken. Takes constant time unless ZERO_ON_FREE has to null it.
+    void ResetTo(RegionMark mark);
+
+    // - Releases everything allocated from a region heap
+    void Reset();
+
+    // - Records every allocating and freeing call to writer from now on, or
+    //   stops recording if writer is NULL. Set it before sharing the heap
+    //   between threads. Recorded calls are made one at a time.
+    void SetTrace(TraceWriter *writer);
+
+    // - Hands the calling thread's cached memory back to a thread safe heap,
+    //   for threads about to exit. The thread may keep using the heap.
+    void ReleaseThreadCache();
+
+    // - Returns a handle to allocated memory that Compact may relocate
+    MemHandle AllocHandle(size_t size);
+
+    // - Deallocates memory owned by a handle
+    void FreeHandle(MemHandle);
+
+    // - Returns the current address of a handle's memory, only valid until
+    //   the next Compact unless the handle is pinned
+    void* Resolve(MemHandle);
 
-    // - Eliminates memory fragmentation
+    // - Stops Compact moving a handle's memory and returns its address
+    void* Pin(MemHandle);
+
+    // - Allows Compact to move a handle's memory again
+    void Unpin(MemHandle);
+
+    // - Eliminates memory fragmentation. Memory owned by unpinned handles
+    //   and raw pointers is moved down; raw pointers are left dangling.
+    //   Under ARENA_PAGES the free tail is handed back to the OS.
     void Compact();
 
-    // - Returns the amount of free memory
-    int Avail();
+    // - Moves roughly maxBytes of unpinned handle memory down into free space,
+    //   resuming where the previous step stopped. Raw pointer allocations are
+    //   never moved. Returns true once a pass over the whole arena is done.
+    bool CompactStep(size_t maxBytes);
+
+    // - Returns the amount of free memory, across chunks in a growable heap
+    size_t Avail();
+
+	// - Returns the total amount of memory, across chunks in a growable heap
+	size_t Total();
+
+	// - Returns the size of the largest free block
+	size_t LargestFree();
+
+	// - Returns the fraction of free memory unusable by a single allocation
+	double Fragmentation();
+
+	// - Returns block counts, free space, fragmentation and counters of the
+	//   calls made so far, across chunks in a growable heap. Walks no
+	//   blocks, so it is cheap enough to call on a busy heap.
+	MemStats Stats();
 
-	// - Returns the total amount of memory
-	int Total();
+	// - Makes ptr the allocation an ARENA_FILE or ARENA_SHARED heap leads
+	//   to when opened, NULL for none. Does nothing to other heaps.
+	void SetRoot(void *ptr);
+
+	// - Returns the root allocation of an ARENA_FILE or ARENA_SHARED heap,
+	//   NULL if it has none or the heap is neither
+	void* Root();
+
+	// - Writes everything an ARENA_FILE heap has changed out to its file,
+	//   which closing the heap does anyway
+	void Sync();
+
+	// - Returns ptr's offset into the arena, for another process sharing
+	//   the heap to find it at with Address. NO_OFFSET if it is outside.
+	static const size_t NO_OFFSET = ~(size_t)0;
+	size_t Offset(void *ptr);
+
+	// - Returns the memory at an offset into the arena, NULL past its end
+	void* Address(size_t offset);
+
+	// - Removes the name of an ARENA_SHARED heap's segment so the next heap
+	//   opening it starts a new one. Heaps already open keep theirs.
+	static void Unlink(char const *path);
 
     // - Prints raw memory contents out
     void Dump();
+
+    // - Writes len bytes of the arena from offset on to out, clipped to the
+    //   arena. Chunks of a growable heap are left out.
+    void Dump(size_t offset, size_t len, std::ostream &out, DumpMode mode = DUMP_HEX);
     friend std::ostream& operator<<(std::ostream&, MemManage const&);
 
     // - Performs a deep copy	
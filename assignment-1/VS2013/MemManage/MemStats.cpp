@@ -0,0 +1,116 @@
+#include "MemStats.h"
+
+using namespace std;
+
+// Names of the MemOp values in exported snapshots
+static char const *const OP_NAMES[MEM_OPS] = { "alloc", "free", "realloc" };
+
+// - Creates counters at 0
+OpCounters::OpCounters() : failed(0)
+{
+	for (int op = 0; op < MEM_OPS; op++)
+		calls[op] = timedCalls[op] = latencyNs[op] = maxLatencyNs[op] = 0;
+	for (int i = 0; i < STATS_BUCKETS; i++)
+		allocSizes[i] = 0;
+}
+
+// - Adds another set of counters into these
+void OpCounters::Add(OpCounters const &other)
+{
+	failed += other.failed;
+	for (int op = 0; op < MEM_OPS; op++)
+	{
+		calls[op] += other.calls[op];
+		timedCalls[op] += other.timedCalls[op];
+		latencyNs[op] += other.latencyNs[op];
+		if (other.maxLatencyNs[op] > maxLatencyNs[op])
+			maxLatencyNs[op] = other.maxLatencyNs[op];
+	}
+	for (int i = 0; i < STATS_BUCKETS; i++)
+		allocSizes[i] += other.allocSizes[i];
+}
+
+// - Creates an empty snapshot
+MemStats::MemStats() : totalBytes(0), freeBytes(0), liveBlocks(0), freeBlocks(0),
+	largestFree(0), fragmentation(0.0)
+{
+	for (int i = 0; i < STATS_BUCKETS; i++)
+		searchLengths[i] = 0;
+}
+
+// - Smallest value counted in a histogram bucket
+unsigned long long MemStats::BucketFloor(int bucket)
+{
+	return bucket == 0 ? 0 : 1ull << (bucket - 1);
+}
+
+// - Writes one value per MemOp as a JSON object
+static void WriteOpsJson(ostream &out, char const *name, unsigned long long const *values)
+{
+	out << ",\"" << name << "\":{";
+	for (int op = 0; op < MEM_OPS; op++)
+		out << (op > 0 ? "," : "") << '"' << OP_NAMES[op] << "\":" << values[op];
+	out << '}';
+}
+
+// - Writes a histogram as a JSON array, dropping empty buckets off the end
+static void WriteHistogramJson(ostream &out, char const *name, unsigned long long const *buckets)
+{
+	int used = STATS_BUCKETS;
+	while (used > 0 && buckets[used - 1] == 0)
+		used--;
+	out << ",\"" << name << "\":[";
+	for (int i = 0; i < used; i++)
+		out << (i > 0 ? "," : "") << buckets[i];
+	out << ']';
+}
+
+// - Writes the snapshot as a single line JSON object
+void MemStats::WriteJson(ostream &out) const
+{
+	out << "{\"totalBytes\":" << totalBytes
+		<< ",\"freeBytes\":" << freeBytes
+		<< ",\"liveBlocks\":" << liveBlocks
+		<< ",\"freeBlocks\":" << freeBlocks
+		<< ",\"largestFree\":" << largestFree
+		<< ",\"fragmentation\":" << fragmentation;
+	WriteOpsJson(out, "calls", ops.calls);
+	out << ",\"failed\":" << ops.failed;
+	WriteOpsJson(out, "timedCalls", ops.timedCalls);
+	WriteOpsJson(out, "latencyNs", ops.latencyNs);
+	WriteOpsJson(out, "maxLatencyNs", ops.maxLatencyNs);
+	WriteHistogramJson(out, "allocSizes", ops.allocSizes);
+	WriteHistogramJson(out, "searchLengths", searchLengths);
+	out << "}\n";
+}
+
+// - Writes the column names matching WriteCsv. Histogram columns are named
+//   after the smallest value their bucket counts.
+void MemStats::WriteCsvHeader(ostream &out)
+{
+	out << "totalBytes,freeBytes,liveBlocks,freeBlocks,largestFree,fragmentation,failed";
+	for (int op = 0; op < MEM_OPS; op++)
+	{
+		out << ',' << OP_NAMES[op] << "Calls," << OP_NAMES[op] << "TimedCalls,"
+			<< OP_NAMES[op] << "LatencyNs," << OP_NAMES[op] << "MaxLatencyNs";
+	}
+	for (int i = 0; i < STATS_BUCKETS; i++)
+		out << ",size" << BucketFloor(i);
+	for (int i = 0; i < STATS_BUCKETS; i++)
+		out << ",search" << BucketFloor(i);
+	out << '\n';
+}
+
+// - Writes the snapshot as a CSV row
+void MemStats::WriteCsv(ostream &out) const
+{
+	out << totalBytes << ',' << freeBytes << ',' << liveBlocks << ',' << freeBlocks << ','
+		<< largestFree << ',' << fragmentation << ',' << ops.failed;
+	for (int op = 0; op < MEM_OPS; op++)
+		out << ',' << ops.calls[op] << ',' << ops.timedCalls[op] << ',' << ops.latencyNs[op] << ',' << ops.maxLatencyNs[op];
+	for (int i = 0; i < STATS_BUCKETS; i++)
+		out << ',' << ops.allocSizes[i];
+	for (int i = 0; i < STATS_BUCKETS; i++)
+		out << ',' << searchLengths[i];
+	out << '\n';
+}
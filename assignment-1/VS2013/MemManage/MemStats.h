@@ -0,0 +1,72 @@
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+
+#include <iostream>
+
+// Per operation latency counters take two clock reads a timed call, so only
+// one call in LATENCY_SAMPLE made by each thread is timed. Define this as 0
+// to compile them out, leaving the latency fields of MemStats at 0.
+#ifndef MEMMANAGE_LATENCY_STATS
+#define MEMMANAGE_LATENCY_STATS 1
+#endif
+static const unsigned int LATENCY_SAMPLE = 64;
+
+// Calls MemStats keeps counters for
+enum MemOp
+{
+	OP_ALLOC,
+	OP_FREE,
+	OP_REALLOC,
+	MEM_OPS
+};
+
+// Histograms have a bucket for 0 and one per power of two above it, bucket
+// k counting values from 2^(k-1) up to 2^k - 1. The last bucket also counts
+// everything larger.
+static const int STATS_BUCKETS = 32;
+
+// Running totals of the calls made on a heap
+struct OpCounters
+{
+	unsigned long long calls[MEM_OPS];
+	unsigned long long failed;						// Allocs and reallocs that returned NULL
+	unsigned long long timedCalls[MEM_OPS];			// Calls the latency counters sampled
+	unsigned long long latencyNs[MEM_OPS];			// Total time spent in sampled calls
+	unsigned long long maxLatencyNs[MEM_OPS];		// Slowest sampled call
+	unsigned long long allocSizes[STATS_BUCKETS];	// Bytes asked for by allocs and reallocs
+
+	// - Creates counters at 0
+	OpCounters();
+
+	// - Adds another set of counters into these
+	void Add(OpCounters const &other);
+};
+
+// Snapshot of a heap's health, cheap enough to take while it is in use
+struct MemStats
+{
+	size_t totalBytes;
+	size_t freeBytes;
+	size_t liveBlocks;			// Allocations handed out, not counting ALLOCATOR_REGION ones
+	size_t freeBlocks;
+	size_t largestFree;
+	double fragmentation;		// Fraction of free memory unusable by a single allocation
+	OpCounters ops;
+	unsigned long long searchLengths[STATS_BUCKETS];	// Free blocks looked at per free list search
+
+	// - Creates an empty snapshot
+	MemStats();
+
+	// - Writes the snapshot as a single line JSON object
+	void WriteJson(std::ostream &out) const;
+
+	// - Writes the column names matching WriteCsv
+	static void WriteCsvHeader(std::ostream &out);
+
+	// - Writes the snapshot as a CSV row
+	void WriteCsv(std::ostream &out) const;
+
+	// - Smallest value counted in a histogram bucket
+	static unsigned long long BucketFloor(int bucket);
+};
+#endif
@@ -0,0 +1,143 @@
+#include "MemTrace.h"
+#include <cstdio>
+
+using namespace std;
+using namespace std::chrono;
+
+// Every trace starts with these bytes, the last being the format version
+static const char TRACE_MAGIC[4] = { 'M', 'T', 'R', '1' };
+
+// - Starts a trace on out, timed from now
+TraceWriter::TraceWriter(ostream &os) : out(os), lastTime(0), nextId(0)
+{
+	start = high_resolution_clock::now();
+	out.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+}
+
+// - Writes seven bits at a time, low bits first, the top bit of each byte
+//   set while more follow
+void TraceWriter::writeVarint(unsigned long long value)
+{
+	char bytes[10];
+	int count = 0;
+	do
+	{
+		bytes[count] = (char)(value & 0x7F);
+		value >>= 7;
+		if (value != 0)
+			bytes[count] |= 0x80;
+		count++;
+	} while (value != 0);
+	out.write(bytes, count);
+}
+
+// - Writes an event stamped with the time since the previous one. The
+//   lock is held by the caller.
+void TraceWriter::writeEvent(TraceOp op, unsigned int id, unsigned long long size)
+{
+	unsigned long long now = (unsigned long long)duration_cast<nanoseconds>(high_resolution_clock::now() - start).count();
+	if (now < lastTime)
+		now = lastTime;
+
+	out.put((char)op);
+	writeVarint(now - lastTime);
+	if (op != TRACE_ALLOC)
+		writeVarint(id);
+	if (op != TRACE_FREE)
+		writeVarint(size);
+	lastTime = now;
+}
+
+// - Records an allocation, ignoring failed ones
+void TraceWriter::Alloc(void *ptr, size_t size)
+{
+	if (ptr == NULL)
+		return;
+
+	lock_guard<mutex> guard(writeLock);
+	ids[ptr] = nextId++;
+	writeEvent(TRACE_ALLOC, 0, size);
+}
+
+// - Records a free, ignoring pointers to nothing allocated
+void TraceWriter::Free(void *ptr)
+{
+	lock_guard<mutex> guard(writeLock);
+	unordered_map<void*, unsigned int>::iterator it = ids.find(ptr);
+	if (it == ids.end())
+		return;
+
+	writeEvent(TRACE_FREE, it->second, 0);
+	ids.erase(it);
+}
+
+// - Records a reallocation, ignoring failed ones. The allocation keeps its
+//   id wherever it moves to.
+void TraceWriter::Realloc(void *ptr, void *newPtr, size_t size)
+{
+	if (newPtr == NULL)
+		return;
+
+	lock_guard<mutex> guard(writeLock);
+	unordered_map<void*, unsigned int>::iterator it = ids.find(ptr);
+	if (it == ids.end())
+		return;
+
+	unsigned int id = it->second;
+	writeEvent(TRACE_REALLOC, id, size);
+	ids.erase(it);
+	ids[newPtr] = id;
+}
+
+// - Checks the header of the trace on in
+TraceReader::TraceReader(istream &is) : in(is), time(0), nextId(0)
+{
+	char magic[sizeof(TRACE_MAGIC)];
+	in.read(magic, sizeof(magic));
+	valid = in.gcount() == sizeof(magic);
+	for (size_t i = 0; valid && i < sizeof(magic); i++)
+		valid = magic[i] == TRACE_MAGIC[i];
+}
+
+// - Returns whether the trace had a valid header
+bool TraceReader::IsValid() const
+{
+	return valid;
+}
+
+// - Reads a varint written by TraceWriter, false if the trace ends first
+bool TraceReader::readVarint(unsigned long long &value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		int byte = in.get();
+		if (byte == EOF)
+			return false;
+		value |= (unsigned long long)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+
+// - Reads the next event, returning false at the end of the trace
+bool TraceReader::Next(TraceEvent &event)
+{
+	int op = valid ? in.get() : EOF;
+	if (op < TRACE_ALLOC || op > TRACE_REALLOC)
+		return false;
+
+	unsigned long long delta, id = 0, size = 0;
+	if (!readVarint(delta)
+		|| (op != TRACE_ALLOC && !readVarint(id))
+		|| (op != TRACE_FREE && !readVarint(size)))
+		return false;
+
+	time += delta;
+	event.op = (TraceOp)op;
+	event.time = time;
+	event.id = op == TRACE_ALLOC ? nextId++ : (unsigned int)id;
+	event.size = size;
+	return true;
+}
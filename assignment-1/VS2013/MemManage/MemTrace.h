@@ -0,0 +1,80 @@
+#ifndef MEMTRACE_H
+#define MEMTRACE_H
+
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+
+// Calls a trace records
+enum TraceOp
+{
+	TRACE_ALLOC,
+	TRACE_FREE,
+	TRACE_REALLOC
+};
+
+// One recorded call. Allocations are numbered in the order they were made
+// and later calls refer to them by number, so a trace replays against any
+// allocator whatever addresses it hands out.
+struct TraceEvent
+{
+	TraceOp op;
+	unsigned long long time;	// Nanoseconds since recording started
+	unsigned int id;			// Allocation made or worked on
+	unsigned long long size;	// Bytes asked for, 0 for frees
+};
+
+// Records successful calls as a compact binary trace. After a four byte
+// header each event is an op byte, the time since the previous event and
+// then the id, for frees and reallocs, and the size, for allocs and
+// reallocs, all as LEB128 varints.
+class TraceWriter
+{
+private:
+	std::ostream &out;
+	std::mutex writeLock;
+	std::chrono::high_resolution_clock::time_point start;
+	unsigned long long lastTime;
+	unsigned int nextId;
+	std::unordered_map<void*, unsigned int> ids;	// Live allocations by address
+
+	void writeVarint(unsigned long long value);
+	void writeEvent(TraceOp op, unsigned int id, unsigned long long size);
+
+public:
+	// - Starts a trace on out, timed from now
+	TraceWriter(std::ostream &out);
+
+	// - Records an allocation, ignoring failed ones
+	void Alloc(void *ptr, size_t size);
+
+	// - Records a free, ignoring pointers to nothing allocated
+	void Free(void *ptr);
+
+	// - Records a reallocation, ignoring failed ones
+	void Realloc(void *ptr, void *newPtr, size_t size);
+};
+
+// Reads back a trace written by TraceWriter
+class TraceReader
+{
+private:
+	std::istream &in;
+	unsigned long long time;
+	unsigned int nextId;
+	bool valid;
+
+	bool readVarint(unsigned long long &value);
+
+public:
+	// - Checks the header of the trace on in
+	TraceReader(std::istream &in);
+
+	// - Returns whether the trace had a valid header
+	bool IsValid() const;
+
+	// - Reads the next event, returning false at the end of the trace
+	bool Next(TraceEvent &event);
+};
+#endif
@@ -0,0 +1,43 @@
+#ifndef OFFSETPTR_H
+#define OFFSETPTR_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Pointer stored as the distance from itself to what it points at, so data
+// linked together with them stays valid wherever its memory gets mapped, as
+// with a file backed MemManage reopened at another address. Only point at
+// memory mapped along with the pointer.
+template <typename T>
+class OffsetPtr
+{
+private:
+	// No T can start one byte into the pointer itself, so that stands for NULL
+	static const ptrdiff_t NULL_OFFSET = 1;
+
+	ptrdiff_t offset;
+
+	void set(T *ptr)
+	{
+		offset = ptr == NULL ? NULL_OFFSET : (ptrdiff_t)((intptr_t)ptr - (intptr_t)this);
+	}
+
+public:
+	OffsetPtr(T *ptr = NULL) { set(ptr); }
+
+	// - Copies point at the same place from wherever they are
+	OffsetPtr(OffsetPtr const &other) { set(other.Get()); }
+	OffsetPtr& operator=(OffsetPtr const &other) { set(other.Get()); return *this; }
+	OffsetPtr& operator=(T *ptr) { set(ptr); return *this; }
+
+	// - Returns the address pointed at
+	T* Get() const
+	{
+		return offset == NULL_OFFSET ? NULL : (T*)((intptr_t)this + offset);
+	}
+
+	T& operator*() const { return *Get(); }
+	T* operator->() const { return Get(); }
+	operator T*() const { return Get(); }
+};
+#endif
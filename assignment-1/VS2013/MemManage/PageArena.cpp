@@ -0,0 +1,509 @@
+#include "PageArena.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <cstring>
+
+// - Shrinks a range to the whole pages inside it, returning false if there
+//   are none
+static bool WholePages(char *&start, size_t &size)
+{
+	size_t page = PageSize();
+	char *first = (char*)(((size_t)start + page - 1) & ~(page - 1));
+	char *last = (char*)(((size_t)start + size) & ~(page - 1));
+	if (first >= last)
+		return false;
+
+	start = first;
+	size = last - first;
+	return true;
+}
+
+#ifdef _WIN32
+
+// - Reserves address space for an arena without committing any of it, so
+//   none of it counts against the commit limit. Large pages need a
+//   privilege and have to be resident up front so hugePages is ignored here.
+char* ReservePages(size_t size, bool)
+{
+	return (char*)VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_READWRITE);
+}
+
+// - Windows has no commit on first touch, committed pages still only become
+//   resident once touched
+void CommitPages(char *start, size_t size)
+{
+	if (size > 0)
+		VirtualAlloc(start, size, MEM_COMMIT, PAGE_READWRITE);
+}
+
+// - Returns address space reserved by ReservePages to the OS
+void ReleasePages(char *start, size_t)
+{
+	if (start != NULL)
+		VirtualFree(start, 0, MEM_RELEASE);
+}
+
+// - Decommitting drops the physical pages, committing again gives back
+//   demand zero pages
+void DiscardPages(char *start, size_t size)
+{
+	if (WholePages(start, size))
+		VirtualFree(start, size, MEM_DECOMMIT);
+}
+
+// - Returns the size of a page
+size_t PageSize()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+}
+
+// - Maps a view of a new section backed by the page file
+char* MapFilePages(size_t size, PageFile &file)
+{
+	file = NO_PAGE_FILE;
+	HANDLE section = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+		(DWORD)((unsigned long long)size >> 32), (DWORD)size, NULL);
+	if (section == NULL)
+		return NULL;
+
+	char *start = (char*)MapViewOfFile(section, FILE_MAP_WRITE, 0, 0, size);
+	if (start == NULL)
+	{
+		CloseHandle(section);
+		return NULL;
+	}
+	file = (PageFile)section;
+	return start;
+}
+
+// - Maps a FILE_MAP_COPY view of another arena's section
+char* MapFileCopy(PageFile source, size_t size, PageFile &file)
+{
+	file = NO_PAGE_FILE;
+	HANDLE section;
+	if (!DuplicateHandle(GetCurrentProcess(), (HANDLE)source, GetCurrentProcess(), &section,
+		0, FALSE, DUPLICATE_SAME_ACCESS))
+		return NULL;
+
+	char *start = (char*)MapViewOfFile(section, FILE_MAP_COPY, 0, 0, size);
+	if (start == NULL)
+	{
+		CloseHandle(section);
+		return NULL;
+	}
+	file = (PageFile)section;
+	return start;
+}
+
+// - A view can only be replaced by unmapping it first, leaving a moment
+//   where anything could take its address, so arenas are never remapped
+bool MakeCopyOnWrite(char *, size_t, PageFile)
+{
+	return false;
+}
+
+// - Views are never made copy-on-write in place, so there is nothing to
+//   tell which pages were written
+void CopyWrittenPages(char const *from, char *to, size_t size)
+{
+	memcpy(to, from, size);
+}
+
+// - Maps a view of a section over the file. The section keeps the file
+//   open, so the file handle is closed straight away.
+char* MapNamedFile(char const *path, size_t newSize, size_t &size, bool &created, PageFile &file)
+{
+	file = NO_PAGE_FILE;
+	HANDLE handle = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	LARGE_INTEGER length;
+	if (!GetFileSizeEx(handle, &length) || (unsigned long long)length.QuadPart > (size_t)-1)
+	{
+		CloseHandle(handle);
+		return NULL;
+	}
+	created = length.QuadPart == 0;
+	size = created ? newSize : (size_t)length.QuadPart;
+
+	HANDLE section = size > 0 ? CreateFileMapping(handle, NULL, PAGE_READWRITE,
+		(DWORD)((unsigned long long)size >> 32), (DWORD)size, NULL) : NULL;
+	CloseHandle(handle);
+	if (section == NULL)
+		return NULL;
+
+	char *start = (char*)MapViewOfFile(section, FILE_MAP_WRITE, 0, 0, size);
+	if (start == NULL)
+	{
+		CloseHandle(section);
+		return NULL;
+	}
+	file = (PageFile)section;
+	return start;
+}
+
+// - Maps a named section backed by the paging file. An existing section
+//   keeps its size, which the view's region gives rounded up to pages.
+char* MapSharedMemory(char const *name, size_t newSize, size_t &size, bool &created, PageFile &file)
+{
+	file = NO_PAGE_FILE;
+	HANDLE section = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+		(DWORD)((unsigned long long)newSize >> 32), (DWORD)newSize, name);
+	if (section == NULL)
+		return NULL;
+	created = GetLastError() != ERROR_ALREADY_EXISTS;
+
+	MEMORY_BASIC_INFORMATION region;
+	char *start = (char*)MapViewOfFile(section, FILE_MAP_WRITE, 0, 0, 0);
+	if (start == NULL || VirtualQuery(start, &region, sizeof(region)) == 0)
+	{
+		if (start != NULL)
+			UnmapViewOfFile(start);
+		CloseHandle(section);
+		return NULL;
+	}
+	size = region.RegionSize;
+	file = (PageFile)section;
+	return start;
+}
+
+// - Sections go with the last handle to them, there is no name to remove
+void UnlinkSharedMemory(char const *)
+{
+}
+
+// - Opens the named mutex, creating it if this is the first process
+ProcessLock OpenProcessLock(void *, char const *name, bool)
+{
+	HANDLE mutex = CreateMutexA(NULL, FALSE, name);
+	return mutex != NULL ? (ProcessLock)mutex : NO_PROCESS_LOCK;
+}
+
+// - Waits for the mutex. One abandoned by a dead process is taken over.
+void LockProcesses(ProcessLock lock)
+{
+	WaitForSingleObject((HANDLE)lock, INFINITE);
+}
+
+void UnlockProcesses(ProcessLock lock)
+{
+	ReleaseMutex((HANDLE)lock);
+}
+
+// - Closes this process's handle to the mutex
+void CloseProcessLock(ProcessLock lock)
+{
+	if (lock != NO_PROCESS_LOCK)
+		CloseHandle((HANDLE)lock);
+}
+
+// - Hands the dirty pages of a view to the file system
+void SyncPages(char *start, size_t size)
+{
+	FlushViewOfFile(start, size);
+}
+
+// - Unmaps a view and closes its section handle
+void UnmapFilePages(char *start, size_t, PageFile file)
+{
+	if (start != NULL)
+		UnmapViewOfFile(start);
+	if (file != NO_PAGE_FILE)
+		CloseHandle((HANDLE)file);
+}
+
+#else
+
+// - Reserves address space for an arena without reserving swap for it
+char* ReservePages(size_t size, bool hugePages)
+{
+	void *start = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (start == MAP_FAILED)
+		return NULL;
+
+#ifdef MADV_HUGEPAGE
+	if (hugePages)
+		madvise(start, size, MADV_HUGEPAGE);
+#endif
+	return (char*)start;
+}
+
+// - Pages are committed on first touch
+void CommitPages(char *, size_t)
+{
+}
+
+// - Returns address space reserved by ReservePages to the OS
+void ReleasePages(char *start, size_t size)
+{
+	if (start != NULL)
+		munmap(start, size);
+}
+
+// - Private anonymous pages read as null again after MADV_DONTNEED
+void DiscardPages(char *start, size_t size)
+{
+	if (WholePages(start, size))
+		madvise(start, size, MADV_DONTNEED);
+}
+
+// - Returns the size of a page
+size_t PageSize()
+{
+	static size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	return pageSize;
+}
+
+// - Creates an anonymous file of size bytes, returning -1 on failure. Without
+//   memfd_create a POSIX shared memory object is unlinked as soon as it is
+//   open.
+static int CreatePageFile(size_t size)
+{
+#ifdef MFD_CLOEXEC
+	int fd = memfd_create("MemManage", MFD_CLOEXEC);
+#else
+	static unsigned int created = 0;
+	char name[64];
+	sprintf(name, "/MemManage.%d.%u", (int)getpid(), __sync_fetch_and_add(&created, 1));
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd >= 0)
+		shm_unlink(name);
+#endif
+	if (fd >= 0 && ftruncate(fd, (off_t)size) != 0)
+	{
+		close(fd);
+		fd = -1;
+	}
+	return fd;
+}
+
+// - Maps a new anonymous file shared, so writes go to the file
+char* MapFilePages(size_t size, PageFile &file)
+{
+	file = NO_PAGE_FILE;
+	int fd = CreatePageFile(size);
+	if (fd < 0)
+		return NULL;
+
+	void *start = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (start == MAP_FAILED)
+	{
+		close(fd);
+		return NULL;
+	}
+	file = fd;
+	return (char*)start;
+}
+
+// - Maps another arena's file private, so writes copy the page first
+char* MapFileCopy(PageFile source, size_t size, PageFile &file)
+{
+	file = NO_PAGE_FILE;
+	int fd = dup((int)source);
+	if (fd < 0)
+		return NULL;
+
+	void *start = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (start == MAP_FAILED)
+	{
+		close(fd);
+		return NULL;
+	}
+	file = fd;
+	return (char*)start;
+}
+
+// - MAP_FIXED replaces the shared mapping with a private one in a single
+//   call. The file already holds everything written through the old one.
+bool MakeCopyOnWrite(char *start, size_t size, PageFile file)
+{
+	return mmap(start, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, (int)file, 0) == start;
+}
+
+// - Pages a private file mapping has copied are anonymous. /proc/self/pagemap
+//   tells them apart, as pages present but not backed by a file or swapped
+//   out, without needing any privileges.
+void CopyWrittenPages(char const *from, char *to, size_t size)
+{
+	const unsigned long long PRESENT = 1ull << 63;
+	const unsigned long long SWAPPED = 1ull << 62;
+	const unsigned long long FILE_PAGE = 1ull << 61;
+	const size_t BATCH = 512;
+
+	int pagemap = open("/proc/self/pagemap", O_RDONLY);
+	size_t page = PageSize();
+	size_t pages = (size + page - 1) / page;
+	unsigned long long entries[BATCH];
+	size_t done = 0;
+	while (pagemap >= 0 && done < pages)
+	{
+		size_t count = pages - done < BATCH ? pages - done : BATCH;
+		off_t at = (off_t)(((size_t)from / page + done) * sizeof(entries[0]));
+		if (pread(pagemap, entries, count * sizeof(entries[0]), at) != (ssize_t)(count * sizeof(entries[0])))
+			break;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			unsigned long long entry = entries[i];
+			if ((entry & SWAPPED) == 0 && ((entry & PRESENT) == 0 || (entry & FILE_PAGE) != 0))
+				continue;
+			size_t offset = (done + i) * page;
+			memcpy(to + offset, from + offset, size - offset < page ? size - offset : page);
+		}
+		done += count;
+	}
+
+	// Without the page map anything could have been written
+	if (done < pages)
+		memcpy(to + done * page, from + done * page, size - done * page);
+	if (pagemap >= 0)
+		close(pagemap);
+}
+
+// - Maps a named file shared, growing an empty one to newSize
+char* MapNamedFile(char const *path, size_t newSize, size_t &size, bool &created, PageFile &file)
+{
+	file = NO_PAGE_FILE;
+	int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0)
+		return NULL;
+
+	off_t length = lseek(fd, 0, SEEK_END);
+	created = length == 0;
+	size = created ? newSize : (size_t)length;
+	if (length < 0 || size == 0 || (created && ftruncate(fd, (off_t)size) != 0))
+	{
+		close(fd);
+		return NULL;
+	}
+
+	void *start = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (start == MAP_FAILED)
+	{
+		close(fd);
+		return NULL;
+	}
+	file = fd;
+	return (char*)start;
+}
+
+// How long MapSharedMemory waits for another process to size a segment it
+// just created, in milliseconds
+static const int SHARED_SIZE_WAIT = 1000;
+
+// - Maps a POSIX shared memory segment. Only the process whose shm_open
+//   created the segment sizes it, any other waits until that is done.
+char* MapSharedMemory(char const *name, size_t newSize, size_t &size, bool &created, PageFile &file)
+{
+	file = NO_PAGE_FILE;
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	created = fd >= 0;
+	if (!created && errno == EEXIST)
+		fd = shm_open(name, O_RDWR, 0600);
+	if (fd < 0)
+		return NULL;
+
+	struct stat info;
+	if (created && (newSize == 0 || ftruncate(fd, (off_t)newSize) != 0))
+	{
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+	for (int waited = 0; fstat(fd, &info) == 0 && info.st_size == 0 && waited < SHARED_SIZE_WAIT; waited++)
+		usleep(1000);
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		close(fd);
+		return NULL;
+	}
+	size = (size_t)info.st_size;
+
+	void *start = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (start == MAP_FAILED)
+	{
+		close(fd);
+		return NULL;
+	}
+	file = fd;
+	return (char*)start;
+}
+
+// - Removes the segment's name, later shm_opens create a new one
+void UnlinkSharedMemory(char const *name)
+{
+	shm_unlink(name);
+}
+
+// - Initialises a process shared, robust, recursive mutex in storage if
+//   the memory was just created. The lock is the mutex's address.
+ProcessLock OpenProcessLock(void *storage, char const *, bool created)
+{
+	static_assert(sizeof(pthread_mutex_t) <= PROCESS_LOCK_BYTES, "pthread_mutex_t does not fit in its storage");
+	pthread_mutex_t *mutex = (pthread_mutex_t*)storage;
+	if (created)
+	{
+		pthread_mutexattr_t attributes;
+		pthread_mutexattr_init(&attributes);
+		pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+		pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+		pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+		int failed = pthread_mutex_init(mutex, &attributes);
+		pthread_mutexattr_destroy(&attributes);
+		if (failed != 0)
+			return NO_PROCESS_LOCK;
+	}
+	return (ProcessLock)mutex;
+}
+
+// - Locks the mutex. One left locked by a dead process is marked usable
+//   again, whatever it guarded is taken as it was left.
+void LockProcesses(ProcessLock lock)
+{
+	pthread_mutex_t *mutex = (pthread_mutex_t*)lock;
+	if (pthread_mutex_lock(mutex) == EOWNERDEAD)
+		pthread_mutex_consistent(mutex);
+}
+
+void UnlockProcesses(ProcessLock lock)
+{
+	pthread_mutex_unlock((pthread_mutex_t*)lock);
+}
+
+// - The mutex belongs to the shared memory, nothing is held per process
+void CloseProcessLock(ProcessLock)
+{
+}
+
+// - Writes what has changed in a range of a file mapping out to the file
+void SyncPages(char *start, size_t size)
+{
+	msync(start, size, MS_SYNC);
+}
+
+// - Unmaps an arena and closes its file, which goes once no arena maps it
+void UnmapFilePages(char *start, size_t size, PageFile file)
+{
+	if (start != NULL)
+		munmap(start, size);
+	if (file != NO_PAGE_FILE)
+		close((int)file);
+}
+
+#endif
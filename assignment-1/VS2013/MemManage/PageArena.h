@@ -0,0 +1,89 @@
+#ifndef PAGEARENA_H
+#define PAGEARENA_H
+
+#include <cstddef>
+#include <cstdint>
+
+// OS object holding the pages of a file backed arena, a file descriptor on
+// POSIX and a section handle on Windows
+typedef intptr_t PageFile;
+static const PageFile NO_PAGE_FILE = -1;
+
+// Recursive lock between processes mapping the same shared memory. On POSIX
+// it is a mutex kept in PROCESS_LOCK_BYTES of that memory, released if its
+// holder dies, and on Windows a named mutex.
+typedef intptr_t ProcessLock;
+static const ProcessLock NO_PROCESS_LOCK = 0;
+static const size_t PROCESS_LOCK_BYTES = 64;
+
+// - Reserves address space for an arena. Pages have to go through
+//   CommitPages before use, only take up physical memory once touched and
+//   start out null. Returns NULL on failure.
+char* ReservePages(size_t size, bool hugePages);
+
+// - Commits the pages covering a range of reserved address space. Already
+//   committed pages are left as they are.
+void CommitPages(char *start, size_t size);
+
+// - Returns address space reserved by ReservePages to the OS
+void ReleasePages(char *start, size_t size);
+
+// - Hands the physical memory behind the whole pages inside a range back to
+//   the OS. The range reads as null once committed again.
+void DiscardPages(char *start, size_t size);
+
+// - Returns the size of a page
+size_t PageSize();
+
+// - Maps size bytes of a new anonymous file, writes going through to the
+//   file. Pages start out null. Returns NULL on failure.
+char* MapFilePages(size_t size, PageFile &file);
+
+// - Maps a copy-on-write view of another arena's file, taking a handle of
+//   its own to it. Writes to the view stay private. Returns NULL on failure.
+char* MapFileCopy(PageFile source, size_t size, PageFile &file);
+
+// - Turns an arena mapped by MapFilePages into a copy-on-write view of its
+//   file in place, keeping its contents and address. From then on the file
+//   never changes, so views of it can share its pages. Returns false where
+//   the OS cannot remap in place.
+bool MakeCopyOnWrite(char *start, size_t size, PageFile file);
+
+// - Copies the pages of one copy-on-write view written since it was mapped
+//   into another view of the same file. Copies every page where the OS
+//   cannot tell which ones those are.
+void CopyWrittenPages(char const *from, char *to, size_t size);
+
+// - Maps the whole of a named file shared, creating it with newSize null
+//   bytes if it does not exist or is empty. Sets size to the file's length
+//   and created to whether it was just made. Returns NULL on failure.
+char* MapNamedFile(char const *path, size_t newSize, size_t &size, bool &created, PageFile &file);
+
+// - Maps the whole of a named shared memory segment, creating it with
+//   newSize null bytes if it does not exist. Sets size to the segment's
+//   length and created to whether it was just made. Returns NULL on failure.
+char* MapSharedMemory(char const *name, size_t newSize, size_t &size, bool &created, PageFile &file);
+
+// - Removes the name of a shared memory segment, which goes once nothing
+//   maps it. Does nothing on Windows, where that happens anyway.
+void UnlinkSharedMemory(char const *name);
+
+// - Sets up a process lock in the storage of the shared memory that was
+//   just created, or finds the one another process set up. The name is
+//   only used on Windows. Returns NO_PROCESS_LOCK on failure.
+ProcessLock OpenProcessLock(void *storage, char const *name, bool created);
+
+// - Takes and releases a process lock
+void LockProcesses(ProcessLock lock);
+void UnlockProcesses(ProcessLock lock);
+
+// - Lets go of this process's hold on a process lock
+void CloseProcessLock(ProcessLock lock);
+
+// - Writes what has changed in a range of a file mapping out to the file
+void SyncPages(char *start, size_t size);
+
+// - Unmaps an arena mapped by MapFilePages, MapFileCopy, MapNamedFile or
+//   MapSharedMemory and closes its handle to the file
+void UnmapFilePages(char *start, size_t size, PageFile file);
+#endif
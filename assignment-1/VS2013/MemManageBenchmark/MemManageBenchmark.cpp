@@ -0,0 +1,1185 @@
+#include "..\MemManage\MemManage.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+// Bytes allocated through operator new while a HeapCounter is live, so
+// benchmarks can see the metadata a heap keeps outside its arena. Outside a
+// counter new and delete only pay for the header
+static atomic<bool> countingHeap(false);
+static atomic<long long> countedHeapBytes(0);
+
+// Kept in front of each allocation, padded to keep alignment
+struct HeapHeader
+{
+	size_t size;
+	size_t counted;
+};
+
+// - Counts the bytes allocated and not freed while it is in scope
+class HeapCounter
+{
+public:
+	HeapCounter()
+	{
+		countedHeapBytes = 0;
+		countingHeap = true;
+	}
+	~HeapCounter() { countingHeap = false; }
+	long long Bytes() const { return countedHeapBytes; }
+};
+
+void* operator new(size_t size)
+{
+	HeapHeader *header = (HeapHeader*)malloc(sizeof(HeapHeader) + size);
+	if (header == NULL)
+		throw bad_alloc();
+	header->size = size;
+	header->counted = countingHeap;
+	if (header->counted)
+		countedHeapBytes += size;
+	return header + 1;
+}
+
+void operator delete(void *ptr)
+{
+	if (ptr == NULL)
+		return;
+	// Through an integer, so the compiler does not take the header for a
+	// read before the start of the object
+	HeapHeader *header = (HeapHeader*)((uintptr_t)ptr - sizeof(HeapHeader));
+	if (header->counted)
+		countedHeapBytes -= header->size;
+	free(header);
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete[](void *ptr)
+{
+	operator delete(ptr);
+}
+
+// - Sized deletes go the same way, the size is already in the header
+void operator delete(void *ptr, size_t)
+{
+	operator delete(ptr);
+}
+
+void operator delete[](void *ptr, size_t)
+{
+	operator delete(ptr);
+}
+
+// - Average Alloc latency in nanoseconds with liveBlocks blocks allocated
+//   and every other one freed, leaving holes spread across the size classes
+double AllocLatency(int liveBlocks)
+{
+	const int MAX_BLOCK = 256;
+	const int BATCH = 1000;
+	const int ROUNDS = 5;
+
+	MemManage mem(liveBlocks * MAX_BLOCK + BATCH * MAX_BLOCK);
+	vector<void*> live(liveBlocks);
+	srand(liveBlocks);
+	for (int i = 0; i < liveBlocks; i++)
+		live[i] = mem.Alloc(1 + rand() % MAX_BLOCK);
+	for (int i = 1; i < liveBlocks; i += 2)
+		mem.Free(live[i]);
+
+	vector<int> sizes(BATCH);
+	vector<void*> batch(BATCH);
+	nanoseconds elapsed(0);
+	for (int round = 0; round < ROUNDS; round++)
+	{
+		for (int i = 0; i < BATCH; i++)
+			sizes[i] = 1 + rand() % MAX_BLOCK;
+
+		// Only the allocations are timed, the frees just restore the heap
+		high_resolution_clock::time_point start = high_resolution_clock::now();
+		for (int i = 0; i < BATCH; i++)
+			batch[i] = mem.Alloc(sizes[i]);
+		elapsed += duration_cast<nanoseconds>(high_resolution_clock::now() - start);
+
+		for (int i = 0; i < BATCH; i++)
+			mem.Free(batch[i]);
+	}
+
+	return (double)elapsed.count() / (BATCH * ROUNDS);
+}
+
+// - Average Free latency in nanoseconds when releasing liveBlocks blocks
+//   in random order
+double FreeLatency(int liveBlocks)
+{
+	const int MAX_BLOCK = 256;
+
+	MemManage mem(liveBlocks * MAX_BLOCK);
+	vector<void*> live(liveBlocks);
+	srand(liveBlocks);
+	for (int i = 0; i < liveBlocks; i++)
+		live[i] = mem.Alloc(1 + rand() % MAX_BLOCK);
+	for (int i = liveBlocks - 1; i > 0; i--)
+		swap(live[i], live[rand() % (i + 1)]);
+
+	high_resolution_clock::time_point start = high_resolution_clock::now();
+	for (int i = 0; i < liveBlocks; i++)
+		mem.Free(live[i]);
+	nanoseconds elapsed = duration_cast<nanoseconds>(high_resolution_clock::now() - start);
+
+	return (double)elapsed.count() / liveBlocks;
+}
+
+// - Churns random sized blocks through an arena, periodically asking for a
+//   block a quarter of the arena in size, and reports how fragmented the
+//   free memory is at the end
+void FragmentationUnderChurn()
+{
+	const int ARENA = 1 << 20;
+	const int SLOTS = 2000;
+	const int OPS = 200000;
+	const int LARGE = ARENA / 4;
+
+	MemManage mem(ARENA);
+	vector<void*> slots(SLOTS, (void*)NULL);
+	int largeAttempts = 0, largeSucceeded = 0;
+	srand(3);
+	for (int op = 1; op <= OPS; op++)
+	{
+		int slot = rand() % SLOTS;
+		if (slots[slot] == NULL)
+			slots[slot] = mem.Alloc(1 + rand() % 512);
+		else
+		{
+			mem.Free(slots[slot]);
+			slots[slot] = NULL;
+		}
+
+		if (op % 1000 == 0)
+		{
+			void *large = mem.Alloc(LARGE);
+			largeAttempts++;
+			if (large != NULL)
+			{
+				largeSucceeded++;
+				mem.Free(large);
+			}
+		}
+	}
+
+	printf("\nFragmentation after %d random ops\n", OPS);
+	printf("%12s %12s %12s %12s\n", "free", "largest", "frag", "large ok");
+	printf("%12llu %12llu %12.3f %8d/%d\n", (unsigned long long)mem.Avail(),
+		(unsigned long long)mem.LargestFree(), mem.Fragmentation(), largeSucceeded, largeAttempts);
+}
+
+// - Fills an arena with handle allocations and frees every other one
+void FragmentWithHandles(MemManage &mem, int blocks, int blockSize)
+{
+	vector<MemHandle> handles(blocks);
+	for (int i = 0; i < blocks; i++)
+		handles[i] = mem.AllocHandle(blockSize);
+	for (int i = 0; i < blocks; i += 2)
+		mem.FreeHandle(handles[i]);
+}
+
+// - Compares the single pause of a full Compact with the longest pause of
+//   an incremental compaction over the same fragmented heap
+void CompactionPauses()
+{
+	const int BLOCKS = 64 * 1024;
+	const int BLOCK_SIZE = 256;
+	const int STEP_BYTES = 64 * 1024;
+
+	MemManage full(BLOCKS * BLOCK_SIZE);
+	FragmentWithHandles(full, BLOCKS, BLOCK_SIZE);
+	high_resolution_clock::time_point start = high_resolution_clock::now();
+	full.Compact();
+	microseconds fullPause = duration_cast<microseconds>(high_resolution_clock::now() - start);
+
+	MemManage incremental(BLOCKS * BLOCK_SIZE);
+	FragmentWithHandles(incremental, BLOCKS, BLOCK_SIZE);
+	microseconds longestStep(0), total(0);
+	int steps = 0;
+	bool done = false;
+	while (!done)
+	{
+		start = high_resolution_clock::now();
+		done = incremental.CompactStep(STEP_BYTES);
+		microseconds step = duration_cast<microseconds>(high_resolution_clock::now() - start);
+		total += step;
+		if (step > longestStep)
+			longestStep = step;
+		steps++;
+	}
+
+	printf("\nCompaction pauses, %d MB arena half free\n", BLOCKS * BLOCK_SIZE >> 20);
+	printf("%12s %12s %12s\n", "mode", "longest us", "total us");
+	printf("%12s %12lld %12lld\n", "Compact", (long long)fullPause.count(), (long long)fullPause.count());
+	printf("%12s %12lld %12lld  (%d steps of %d KB)\n", "CompactStep", (long long)longestStep.count(),
+		(long long)total.count(), steps, STEP_BYTES >> 10);
+}
+
+// - Moves every other block of blockSize down over the freed ones with the
+//   original byte-at-a-time copy and null loop, returning the seconds taken
+double ScalarRelocate(vector<char> &arena, int blockSize)
+{
+	int blocks = (int)arena.size() / blockSize;
+	high_resolution_clock::time_point start = high_resolution_clock::now();
+	for (int i = 1; i < blocks; i += 2)
+	{
+		char *dest = &arena[(i / 2) * blockSize];
+		int offset = (i - i / 2) * blockSize;
+		for (int j = 0; j < blockSize; j++)
+		{
+			dest[j] = dest[j + offset];
+			dest[j + offset] = '\0';
+		}
+	}
+	return duration_cast<duration<double>>(high_resolution_clock::now() - start).count();
+}
+
+// - Compacts an arena where every other block of blockSize has been freed,
+//   returning the seconds taken
+double CompactRelocate(int arenaSize, int blockSize, ZeroPolicy zeroPolicy)
+{
+	MemManageOptions options;
+	options.zeroPolicy = zeroPolicy;
+	MemManage mem(arenaSize, options);
+	vector<void*> blocks(arenaSize / blockSize);
+	for (size_t i = 0; i < blocks.size(); i++)
+		memset(blocks[i] = mem.Alloc(blockSize), (int)i, blockSize);
+	for (size_t i = 0; i < blocks.size(); i += 2)
+		mem.Free(blocks[i]);
+
+	high_resolution_clock::time_point start = high_resolution_clock::now();
+	mem.Compact();
+	return duration_cast<duration<double>>(high_resolution_clock::now() - start).count();
+}
+
+// - Relocation throughput of the original byte loop against Compact, for
+//   block sizes below and above the non-temporal store threshold
+void RelocationThroughput()
+{
+	const int ARENA = 128 << 20;
+	const double MOVED_GB = ARENA / 2 / 1e9;
+
+	printf("\nRelocation throughput, %d MB arena half free (GB/s)\n", ARENA >> 20);
+	printf("%12s %12s %12s %12s\n", "block", "byte loop", "wipe", "no wipe");
+	int blockSizes[] = { 64 << 10, 8 << 20 };
+	for (int i = 0; i < 2; i++)
+	{
+		vector<char> arena(ARENA, 1);
+		double scalar = ScalarRelocate(arena, blockSizes[i]);
+		double wiped = CompactRelocate(ARENA, blockSizes[i], ZERO_ON_FREE);
+		double unwiped = CompactRelocate(ARENA, blockSizes[i], ZERO_NONE);
+		printf("%10dKB %12.2f %12.2f %12.2f\n", blockSizes[i] >> 10,
+			MOVED_GB / scalar, MOVED_GB / wiped, MOVED_GB / unwiped);
+	}
+}
+
+// - Construction time of a large arena and the cost of an alloc, fill and
+//   free cycle under each zeroing policy
+void ZeroingPolicies()
+{
+	const int ARENA = 256 << 20;
+	const int BLOCK = 4096;
+	const int CYCLES = 100000;
+	const char *names[] = { "none", "on free", "on alloc", "lazy" };
+	ZeroPolicy policies[] = { ZERO_NONE, ZERO_ON_FREE, ZERO_ON_ALLOC, ZERO_LAZY };
+
+	printf("\nZeroing policies, %d MB arena, %d byte blocks\n", ARENA >> 20, BLOCK);
+	printf("%12s %12s %12s\n", "policy", "create us", "ns/cycle");
+	for (int i = 0; i < 4; i++)
+	{
+		MemManageOptions options;
+		options.zeroPolicy = policies[i];
+
+		high_resolution_clock::time_point start = high_resolution_clock::now();
+		MemManage *mem = new MemManage(ARENA, options);
+		microseconds create = duration_cast<microseconds>(high_resolution_clock::now() - start);
+
+		// A few live blocks keep the cycling block from always reusing the
+		// same memory
+		void *live[16];
+		for (int j = 0; j < 16; j++)
+			live[j] = mem->Alloc(BLOCK);
+
+		start = high_resolution_clock::now();
+		for (int j = 0; j < CYCLES; j++)
+		{
+			int slot = j % 16;
+			mem->Free(live[slot]);
+			memset(live[slot] = mem->Alloc(BLOCK), j, BLOCK);
+		}
+		nanoseconds cycles = duration_cast<nanoseconds>(high_resolution_clock::now() - start);
+		delete mem;
+
+		printf("%12s %12lld %12.1f\n", names[i], (long long)create.count(), (double)cycles.count() / CYCLES);
+	}
+}
+
+// - Alloc and Free latency across an arena reserving more address space
+//   than 32 bit sizes can describe. Blocks are never touched so only the
+//   block records take up memory.
+void LargeArena()
+{
+	const size_t GB = (size_t)1 << 30;
+	const size_t ARENA = 16 * GB;
+	const size_t BLOCK = 1 << 20;
+	const int BLOCKS = (int)(ARENA / BLOCK);
+
+	printf("\nLarge arena, %llu GB reserved, %llu KB blocks\n",
+		(unsigned long long)(ARENA / GB), (unsigned long long)(BLOCK >> 10));
+	if (sizeof(size_t) < 8)
+	{
+		printf("%12s\n", "needs a 64 bit build");
+		return;
+	}
+
+	MemManageOptions options;
+	options.zeroPolicy = ZERO_NONE;
+	options.backend = ARENA_PAGES;
+	high_resolution_clock::time_point start = high_resolution_clock::now();
+	MemManage mem(ARENA, options);
+	microseconds create = duration_cast<microseconds>(high_resolution_clock::now() - start);
+
+	vector<void*> blocks(BLOCKS);
+	start = high_resolution_clock::now();
+	for (int i = 0; i < BLOCKS; i++)
+		blocks[i] = mem.Alloc(BLOCK);
+	nanoseconds allocs = duration_cast<nanoseconds>(high_resolution_clock::now() - start);
+
+	srand(9);
+	for (int i = BLOCKS - 1; i > 0; i--)
+		swap(blocks[i], blocks[rand() % (i + 1)]);
+	start = high_resolution_clock::now();
+	for (int i = 0; i < BLOCKS; i++)
+		mem.Free(blocks[i]);
+	nanoseconds frees = duration_cast<nanoseconds>(high_resolution_clock::now() - start);
+
+	printf("%12s %12s %12s %12s\n", "create us", "ns/alloc", "ns/free", "free GB");
+	printf("%12lld %12.1f %12.1f %12llu\n", (long long)create.count(),
+		(double)allocs.count() / BLOCKS, (double)frees.count() / BLOCKS,
+		(unsigned long long)(mem.Avail() / GB));
+}
+
+// - Runs a small block alloc and free loop on several threads at once,
+//   returning millions of operations a second. Without a thread safe heap
+//   every call is wrapped in one global mutex.
+double ThreadedChurn(int threadCount, bool threadSafe)
+{
+	const int OPS = 200000;
+	const int WINDOW = 64;
+
+	MemManageOptions options;
+	options.threadSafe = threadSafe;
+	MemManage mem(64 << 20, options);
+	mutex globalLock;
+
+	vector<thread> threads;
+	high_resolution_clock::time_point start = high_resolution_clock::now();
+	for (int t = 0; t < threadCount; t++)
+	{
+		threads.push_back(thread([&, t]()
+		{
+			void *live[WINDOW] = { NULL };
+			unsigned int seed = t + 1;
+			for (int op = 0; op < OPS; op++)
+			{
+				seed = seed * 1103515245 + 12345;
+				int slot = (seed >> 8) % WINDOW;
+				size_t size = 16 + (seed >> 16) % 240;
+				if (threadSafe)
+				{
+					mem.Free(live[slot]);
+					live[slot] = mem.Alloc(size);
+				}
+				else
+				{
+					lock_guard<mutex> guard(globalLock);
+					mem.Free(live[slot]);
+					live[slot] = mem.Alloc(size);
+				}
+			}
+		}));
+	}
+	for (int t = 0; t < threadCount; t++)
+		threads[t].join();
+	double seconds = duration_cast<duration<double>>(high_resolution_clock::now() - start).count();
+
+	return 2.0 * OPS * threadCount / seconds / 1e6;
+}
+
+// - Throughput of a globally locked heap against a thread safe one
+void ThreadScaling()
+{
+	printf("\nSmall block churn across threads (M ops/s)\n");
+	printf("%12s %12s %12s\n", "threads", "global lock", "thread safe");
+	for (int threads = 1; threads <= 8; threads *= 2)
+		printf("%12d %12.2f %12.2f\n", threads, ThreadedChurn(threads, false), ThreadedChurn(threads, true));
+}
+
+// - Churns random sized blocks through an arena with the given allocator,
+//   printing a row of ns per operation, how much memory its blocks take
+//   beyond what was asked for and how fragmented free memory ends up
+void AllocatorChurn(char const *name, BlockAllocator allocator)
+{
+	const int ARENA = 4 << 20;
+	const int SLOTS = 4000;
+	const int OPS = 400000;
+
+	MemManageOptions options;
+	options.allocator = allocator;
+	MemManage mem(ARENA, options);
+	vector<void*> slots(SLOTS, (void*)NULL);
+	vector<int> sizes(SLOTS, 0);
+	size_t requested = 0;
+	int failed = 0;
+	srand(5);
+
+	high_resolution_clock::time_point start = high_resolution_clock::now();
+	for (int op = 0; op < OPS; op++)
+	{
+		int slot = rand() % SLOTS;
+		if (slots[slot] == NULL)
+		{
+			sizes[slot] = 1 + rand() % 1024;
+			slots[slot] = mem.Alloc(sizes[slot]);
+			if (slots[slot] != NULL)
+				requested += sizes[slot];
+			else
+				failed++;
+		}
+		else
+		{
+			mem.Free(slots[slot]);
+			slots[slot] = NULL;
+			requested -= sizes[slot];
+		}
+	}
+	nanoseconds elapsed = duration_cast<nanoseconds>(high_resolution_clock::now() - start);
+
+	size_t used = mem.Total() - mem.Avail();
+	printf("%12s %12.1f %12.3f %12.3f %12d\n", name, (double)elapsed.count() / OPS,
+		(double)used / requested - 1.0, mem.Fragmentation(), failed);
+}
+
+// - The segregated free lists against the buddy allocator on the same churn
+void BuddyVersusFreeList()
+{
+	printf("\nAllocator churn, sizes 1 to 1024 bytes\n");
+	printf("%12s %12s %12s %12s %12s\n", "allocator", "ns/op", "overhead", "frag", "failed");
+	AllocatorChurn("free list", ALLOCATOR_FREE_LIST);
+	AllocatorChurn("buddy", ALLOCATOR_BUDDY);
+}
+
+// - Allocates and frees count blocks of one size, printing a row of ns per
+//   Alloc and Free and the bytes each object costs beyond its size, in the
+//   arena and in metadata kept outside it
+void SlabRow(size_t size, bool slabs)
+{
+	const int COUNT = 100000;
+
+	MemManageOptions options;
+	options.slabs = slabs;
+	MemManage mem(64 << 20, options);
+	vector<void*> live(COUNT);
+	HeapCounter counter;
+
+	high_resolution_clock::time_point start = high_resolution_clock::now();
+	for (int i = 0; i < COUNT; i++)
+		live[i] = mem.Alloc(size);
+	nanoseconds allocs = duration_cast<nanoseconds>(high_resolution_clock::now() - start);
+
+	double arenaBytes = (double)(mem.Total() - mem.Avail()) / COUNT - size;
+	double sideBytes = (double)counter.Bytes() / COUNT;
+
+	srand(7);
+	for (int i = COUNT - 1; i > 0; i--)
+		swap(live[i], live[rand() % (i + 1)]);
+	start = high_resolution_clock::now();
+	for (int i = 0; i < COUNT; i++)
+		mem.Free(live[i]);
+	nanoseconds frees = duration_cast<nanoseconds>(high_resolution_clock::now() - start);
+
+	printf("%12llu %12s %12.1f %12.1f %12.1f %12.1f\n", (unsigned long long)size, slabs ? "slabs" : "blocks",
+		(double)allocs.count() / COUNT, (double)frees.count() / COUNT, arenaBytes, sideBytes);
+}
+
+// - Small blocks from the block table against the same from slabs
+void SlabOverhead()
+{
+	size_t sizes[] = { 16, 64, 200 };
+	printf("\nSmall block cost, per object\n");
+	printf("%12s %12s %12s %12s %12s %12s\n", "size", "path", "ns/alloc", "ns/free", "arena waste", "metadata");
+	for (int i = 0; i < 3; i++)
+	{
+		SlabRow(sizes[i], false);
+		SlabRow(sizes[i], true);
+	}
+}
+
+// - Serves requests that each allocate a batch of small objects and drop
+//   them all at the end, printing a row of ns per object. The free list
+//   heap frees every object, the region heap resets once per request.
+void RequestRow(char const *name, BlockAllocator allocator)
+{
+	const int REQUESTS = 2000;
+	const int OBJECTS = 500;
+
+	MemManageOptions options;
+	options.allocator = allocator;
+	options.zeroPolicy = ZERO_LAZY;
+	MemManage mem(1 << 20, options);
+	vector<void*> live(OBJECTS);
+
+	high_resolution_clock::time_point start = high_resolution_clock::now();
+	for (int request = 0; request < REQUESTS; request++)
+	{
+		for (int i = 0; i < OBJECTS; i++)
+			live[i] = mem.Alloc(16 + (i * 7) % 112);
+		if (allocator == ALLOCATOR_REGION)
+			mem.Reset();
+		else
+		{
+			for (int i = 0; i < OBJECTS; i++)
+				mem.Free(live[i]);
+		}
+	}
+	nanoseconds elapsed = duration_cast<nanoseconds>(high_resolution_clock::now() - start);
+
+	printf("%12s %12.1f\n", name, (double)elapsed.count() / (REQUESTS * OBJECTS));
+}
+
+// - Request scoped allocation with per object frees against a region
+void RequestScoped()
+{
+	printf("\nRequest scoped allocation, alloc and release per object\n");
+	printf("%12s %12s\n", "allocator", "ns/object");
+	RequestRow("free list", ALLOCATOR_FREE_LIST);
+	RequestRow("region", ALLOCATOR_REGION);
+}
+
+// - Ramps live memory up to a peak eight times the starting arena and back
+//   down, printing a row of ns per operation, failed allocations and the
+//   memory the heap ended up holding
+void PeakLoadRow(char const *name, bool growable)
+{
+	const int ARENA = 1 << 20;
+	const int BLOCK = 512;
+	const int PEAK = 8 * ARENA / BLOCK;
+	const int ROUNDS = 5;
+
+	MemManageOptions options;
+	options.growable = growable;
+	MemManage mem(ARENA, options);
+	vector<void*> live;
+	int failed = 0;
+
+	high_resolution_clock::time_point start = high_resolution_clock::now();
+	for (int round = 0; round < ROUNDS; round++)
+	{
+		for (int i = 0; i < PEAK; i++)
+		{
+			void *ptr = mem.Alloc(BLOCK);
+			if (ptr != NULL)
+				live.push_back(ptr);
+			else
+				failed++;
+		}
+		for (size_t i = 0; i < live.size(); i++)
+			mem.Free(live[i]);
+		live.clear();
+	}
+	nanoseconds elapsed = duration_cast<nanoseconds>(high_resolution_clock::now() - start);
+
+	printf("%12s %12.1f %12d %12llu\n", name, (double)elapsed.count() / (2 * PEAK * ROUNDS),
+		failed, (unsigned long long)(mem.Total() >> 10));
+}
+
+// - A fixed arena against one that grows into chunks under peak load
+void PeakLoad()
+{
+	printf("\nPeak load of 8x a 1 MB arena\n");
+	printf("%12s %12s %12s %12s\n", "arena", "ns/op", "failed", "total KB");
+	PeakLoadRow("fixed", false);
+	PeakLoadRow("growable", true);
+}
+
+// - Grows many strings a few bytes at a time in interleaved order, the way
+//   builders appending to several buffers do, and reports how many
+//   Reallocs had to relocate the memory
+void StringBuilders()
+{
+	const int BUILDERS = 64;
+	const int APPENDS = 200;
+
+	MemManage mem(4 << 20);
+	vector<char*> strings(BUILDERS);
+	vector<size_t> lengths(BUILDERS, 16);
+	for (int i = 0; i < BUILDERS; i++)
+		strings[i] = (char*)mem.Alloc(16);
+
+	// Every so often a builder finishes and starts over, leaving holes
+	// in front of its neighbours
+	int reallocs = 0, relocated = 0;
+	srand(11);
+	high_resolution_clock::time_point start = high_resolution_clock::now();
+	for (int round = 0; round < APPENDS; round++)
+	{
+		for (int i = 0; i < BUILDERS; i++)
+		{
+			int builder = rand() % BUILDERS;
+			if (rand() % 50 == 0)
+			{
+				mem.Free(strings[builder]);
+				strings[builder] = (char*)mem.Alloc(16);
+				lengths[builder] = 16;
+				continue;
+			}
+
+			lengths[builder] += 1 + rand() % 24;
+			char *grown = (char*)mem.Realloc(strings[builder], lengths[builder]);
+			reallocs++;
+			relocated += grown != strings[builder];
+			strings[builder] = grown;
+		}
+	}
+	nanoseconds elapsed = duration_cast<nanoseconds>(high_resolution_clock::now() - start);
+
+	printf("\nString builder Realloc growth\n");
+	printf("%12s %12s %12s\n", "reallocs", "relocated", "ns/realloc");
+	printf("%12d %11.1f%% %12.1f\n", reallocs, 100.0 * relocated / reallocs, (double)elapsed.count() / reallocs);
+}
+
+// - Churns random sized buffers through an arena, every one aligned to
+//   alignment, printing a row of ns per operation and how fragmented free
+//   memory ends up. Padding stays free so shows up as fragmentation.
+//   Alignment 1 is plain Alloc.
+void AlignedChurnRow(size_t alignment)
+{
+	const int ARENA = 4 << 20;
+	const int SLOTS = 4000;
+	const int OPS = 400000;
+
+	MemManage mem(ARENA);
+	vector<void*> slots(SLOTS, (void*)NULL);
+	srand(13);
+
+	high_resolution_clock::time_point start = high_resolution_clock::now();
+	for (int op = 0; op < OPS; op++)
+	{
+		int slot = rand() % SLOTS;
+		if (slots[slot] == NULL)
+		{
+			size_t size = 1 + rand() % 1024;
+			slots[slot] = alignment > 1 ? mem.AllocAligned(size, alignment) : mem.Alloc(size);
+		}
+		else
+		{
+			mem.Free(slots[slot]);
+			slots[slot] = NULL;
+		}
+	}
+	nanoseconds elapsed = duration_cast<nanoseconds>(high_resolution_clock::now() - start);
+
+	printf("%12llu %12.1f %12llu %12.3f\n", (unsigned long long)alignment, (double)elapsed.count() / OPS,
+		(unsigned long long)(mem.LargestFree() >> 10), mem.Fragmentation());
+}
+
+// - Plain allocations against ones aligned for vector loads
+void AlignedChurn()
+{
+	printf("\nAligned buffer churn, sizes 1 to 1024 bytes\n");
+	printf("%12s %12s %12s %12s\n", "alignment", "ns/op", "largest KB", "frag");
+	for (size_t alignment = 1; alignment <= 64; alignment *= 4)
+		AlignedChurnRow(alignment);
+}
+
+// - Sets up and tears down count same sized objects at once, one call per
+//   object or one batch call, printing a row of ns per object for each phase
+void BatchRow(int count, bool batched)
+{
+	const int ROUNDS = 20;
+	const size_t SIZE = 512;
+
+	MemManage mem(count * SIZE + (1 << 20));
+	vector<void*> ptrs(count);
+
+	// Some live blocks in the way so the heap is not a single free block
+	vector<void*> scattered;
+	for (int i = 0; i < 256; i++)
+		scattered.push_back(mem.Alloc(SIZE));
+	for (int i = 0; i < 256; i += 2)
+		mem.Free(scattered[i]);
+
+	nanoseconds allocs(0), frees(0);
+	for (int round = 0; round < ROUNDS; round++)
+	{
+		high_resolution_clock::time_point start = high_resolution_clock::now();
+		if (batched)
+			mem.AllocBatch(SIZE, count, &ptrs[0]);
+		else
+		{
+			for (int i = 0; i < count; i++)
+				ptrs[i] = mem.Alloc(SIZE);
+		}
+		high_resolution_clock::time_point middle = high_resolution_clock::now();
+		if (batched)
+			mem.FreeBatch(&ptrs[0], count);
+		else
+		{
+			for (int i = 0; i < count; i++)
+				mem.Free(ptrs[i]);
+		}
+		allocs += duration_cast<nanoseconds>(middle - start);
+		frees += duration_cast<nanoseconds>(high_resolution_clock::now() - middle);
+	}
+
+	printf("%12d %12s %12.1f %12.1f\n", count, batched ? "batch" : "single",
+		(double)allocs.count() / (count * ROUNDS), (double)frees.count() / (count * ROUNDS));
+}
+
+// - Single Alloc and Free calls against AllocBatch and FreeBatch
+void BatchAllocation()
+{
+	printf("\nBulk setup and teardown of 512 byte objects\n");
+	printf("%12s %12s %12s %12s\n", "objects", "calls", "ns/alloc", "ns/free");
+	for (int count = 100; count <= 10000; count *= 10)
+	{
+		BatchRow(count, false);
+		BatchRow(count, true);
+	}
+}
+
+// - Size of the next block in one of the placement workloads. Uniform
+//   sizes run from 1 to 1024 bytes, bimodal ones are mostly small with the
+//   odd large buffer and phased ones grow in size as the run goes on.
+size_t WorkloadSize(int workload, int op, int ops)
+{
+	if (workload == 0)
+		return 1 + rand() % 1024;
+	if (workload == 1)
+		return rand() % 20 == 0 ? 4096 + rand() % 12288 : 16 + rand() % 48;
+	return 1 + rand() % (32 + 2048 * op / ops);
+}
+
+// - Runs a workload through a heap with the given placement policy,
+//   printing a row of throughput, failed allocations and how fragmented
+//   free memory ends up
+void PolicyRow(char const *name, PlacementPolicy placement, int workload)
+{
+	const int ARENA = 4 << 20;
+	const int SLOTS = 4000;
+	const int OPS = 200000;
+
+	MemManageOptions options;
+	options.placement = placement;
+	MemManage mem(ARENA, options);
+	vector<void*> slots(SLOTS, (void*)NULL);
+	int failed = 0;
+	srand(17);
+
+	high_resolution_clock::time_point start = high_resolution_clock::now();
+	for (int op = 0; op < OPS; op++)
+	{
+		int slot = rand() % SLOTS;
+		if (slots[slot] == NULL)
+		{
+			slots[slot] = mem.Alloc(WorkloadSize(workload, op, OPS));
+			failed += slots[slot] == NULL;
+		}
+		else
+		{
+			mem.Free(slots[slot]);
+			slots[slot] = NULL;
+		}
+	}
+	double seconds = duration_cast<duration<double>>(high_resolution_clock::now() - start).count();
+
+	printf("%12s %12.2f %12d %12.3f\n", name, OPS / seconds / 1e6, failed, mem.Fragmentation());
+}
+
+// - Every placement policy on each synthetic workload
+void PlacementPolicies()
+{
+	char const *workloads[] = { "uniform", "bimodal", "phased" };
+	char const *names[] = { "segregated", "first fit", "next fit", "best fit", "worst fit" };
+	PlacementPolicy policies[] = { PLACE_SEGREGATED, PLACE_FIRST_FIT, PLACE_NEXT_FIT, PLACE_BEST_FIT, PLACE_WORST_FIT };
+	for (int workload = 0; workload < 3; workload++)
+	{
+		printf("\nPlacement policies, %s sizes\n", workloads[workload]);
+		printf("%12s %12s %12s %12s\n", "policy", "M ops/s", "failed", "frag");
+		for (int i = 0; i < 5; i++)
+			PolicyRow(names[i], policies[i], workload);
+	}
+}
+
+// - Time to take and export a stats snapshot of a heap with liveBlocks
+//   blocks allocated and every other one freed
+void StatsRow(int liveBlocks)
+{
+	const int MAX_BLOCK = 256;
+	const int SNAPSHOTS = 100;
+
+	MemManage mem(liveBlocks * MAX_BLOCK);
+	vector<void*> live(liveBlocks);
+	srand(21);
+	for (int i = 0; i < liveBlocks; i++)
+		live[i] = mem.Alloc(1 + rand() % MAX_BLOCK);
+	for (int i = 1; i < liveBlocks; i += 2)
+		mem.Free(live[i]);
+
+	stringstream json;
+	high_resolution_clock::time_point start = high_resolution_clock::now();
+	for (int i = 0; i < SNAPSHOTS; i++)
+		mem.Stats();
+	double statsMicros = duration_cast<duration<double, micro>>(high_resolution_clock::now() - start).count() / SNAPSHOTS;
+	MemStats stats = mem.Stats();
+	start = high_resolution_clock::now();
+	for (int i = 0; i < SNAPSHOTS; i++)
+	{
+		json.str("");
+		stats.WriteJson(json);
+	}
+	double jsonMicros = duration_cast<duration<double, micro>>(high_resolution_clock::now() - start).count() / SNAPSHOTS;
+
+	printf("%12d %12.2f %12.2f %12u\n", liveBlocks, statsMicros, jsonMicros, (unsigned)json.str().size());
+}
+
+// - Stats snapshots stay cheap as the heap grows
+void StatsSnapshots()
+{
+	printf("\nStats snapshot cost by live block count\n");
+	printf("%12s %12s %12s %12s\n", "live blocks", "us/Stats", "us/json", "json bytes");
+	for (int liveBlocks = 1000; liveBlocks <= 64000; liveBlocks *= 4)
+		StatsRow(liveBlocks);
+}
+
+// Stream buffer that copies whatever is written to it into a preallocated
+// window, wrapping round at its end, and counts it. Every byte is really
+// stored, as a file or socket buffer would, without growing like a
+// stringstream over the whole dump.
+class SinkBuffer : public streambuf
+{
+public:
+	unsigned long long written;
+
+	SinkBuffer() : written(0), window(4 << 20), position(0) {}
+
+protected:
+	int overflow(int c)
+	{
+		char ch = (char)c;
+		xsputn(&ch, 1);
+		return c;
+	}
+
+	streamsize xsputn(char const *data, streamsize count)
+	{
+		size_t left = (size_t)count;
+		while (left > 0)
+		{
+			size_t chunk = min(left, window.size() - position);
+			memcpy(&window[position], data, chunk);
+			position = (position + chunk) % window.size();
+			data += chunk;
+			left -= chunk;
+		}
+		written += count;
+		return count;
+	}
+
+private:
+	vector<char> window;
+	size_t position;
+};
+
+// - Prints a row of dump throughput in MB of arena per second
+void DumpRow(char const *name, size_t arenaBytes, SinkBuffer &sink, high_resolution_clock::time_point start)
+{
+	double seconds = duration_cast<duration<double>>(high_resolution_clock::now() - start).count();
+	printf("%12s %12.1f %12.1f\n", name, arenaBytes / seconds / (1 << 20), sink.written / (double)(1 << 20));
+	sink.written = 0;
+}
+
+// - Dumps a 64 MB arena of 64000 blocks every way there is, against the per
+//   byte iostream formatting operator<< used to do
+void DumpThroughput()
+{
+	const size_t ARENA = 64 << 20;
+	const int BLOCKS = 64000;
+
+	MemManage mem(ARENA);
+	srand(22);
+	for (int i = 0; i < BLOCKS; i++)
+	{
+		size_t size = ARENA / BLOCKS;
+		char *block = (char*)mem.Alloc(size);
+		for (size_t j = 0; j < size; j++)
+			block[j] = (char)rand();
+	}
+	SinkBuffer sink;
+	ostream out(&sink);
+
+	printf("\nDumping a 64 MB arena\n");
+	printf("%12s %12s %12s\n", "dump", "MB/s", "MB written");
+
+	// What operator<< used to do, over a copy of the same bytes
+	vector<char> bytes(ARENA);
+	{
+		stringstream raw;
+		mem.Dump(0, ARENA, raw, DUMP_RAW);
+		raw.read(&bytes[0], ARENA);
+	}
+	high_resolution_clock::time_point start = high_resolution_clock::now();
+	out << hex << uppercase << setfill('0');
+	for (size_t i = 0; i < ARENA; i++)
+	{
+		out << setw(2) << (unsigned(bytes[i]) & 0xFF);
+		if ((i + 1) % 16 == 0)
+			out << '\n';
+		else if (i != ARENA - 1)
+			out << " ";
+	}
+	DumpRow("setw", ARENA, sink, start);
+
+	start = high_resolution_clock::now();
+	out << mem;
+	DumpRow("operator<<", ARENA, sink, start);
+
+	start = high_resolution_clock::now();
+	mem.Dump(0, ARENA, out);
+	DumpRow("hex", ARENA, sink, start);
+
+	start = high_resolution_clock::now();
+	mem.Dump(0, ARENA, out, DUMP_BLOCKS);
+	DumpRow("blocks", ARENA, sink, start);
+
+	start = high_resolution_clock::now();
+	mem.Dump(0, ARENA, out, DUMP_RAW);
+	DumpRow("raw", ARENA, sink, start);
+}
+
+// - Milliseconds taken to copy a heap
+double CopyMillis(MemManage &from)
+{
+	high_resolution_clock::time_point start = high_resolution_clock::now();
+	MemManage copy(from);
+	return duration_cast<duration<double, milli>>(high_resolution_clock::now() - start).count();
+}
+
+// - Copies a 256 MB heap of 4096 written blocks, deeply and as snapshots,
+//   before and after rewriting a few of the blocks
+void SnapshotRow(char const *name, ArenaBackend backend)
+{
+	const size_t ARENA = 256 << 20;
+	const int BLOCKS = 4096;
+	const int REWRITTEN = 40;
+
+	MemManageOptions options;
+	options.backend = backend;
+	MemManage mem(ARENA, options);
+	vector<char*> blocks(BLOCKS);
+	for (int i = 0; i < BLOCKS; i++)
+		memset(blocks[i] = (char*)mem.Alloc(ARENA / BLOCKS), i, ARENA / BLOCKS);
+
+	double first = CopyMillis(mem);
+	for (int i = 0; i < REWRITTEN; i++)
+		memset(blocks[i * (BLOCKS / REWRITTEN)], 0xFF, ARENA / BLOCKS);
+	double second = CopyMillis(mem);
+	printf("%12s %12.2f %12.2f\n", name, first, second);
+}
+
+// - Checkpointing a large heap by deep copy and by copy-on-write snapshot
+void Snapshots()
+{
+	printf("\nCopying a 256 MB heap, then again after rewriting 1%% of it\n");
+	printf("%12s %12s %12s\n", "arena", "first ms", "second ms");
+	SnapshotRow("heap", ARENA_HEAP);
+	SnapshotRow("snapshot", ARENA_SNAPSHOT);
+}
+
+// Entry of the index WarmRestart builds
+struct IndexNode
+{
+	unsigned int key;
+	OffsetPtr<IndexNode> next;
+	char payload[40];
+};
+
+// - Builds a linked index of count nodes in mem, returning its head, which
+//   is also made the root of a file heap
+static IndexNode* BuildIndex(MemManage &mem, int count)
+{
+	IndexNode *head = NULL;
+	for (int i = 0; i < count; i++)
+	{
+		IndexNode *node = (IndexNode*)mem.Alloc(sizeof(IndexNode));
+		node->key = (unsigned int)i * 2654435761u;
+		memset(node->payload, i & 0xFF, sizeof(node->payload));
+		node->next = head;
+		head = node;
+	}
+	mem.SetRoot(head);
+	return head;
+}
+
+// - Sums the keys of an index, so it is all read
+static unsigned int WalkIndex(IndexNode *head)
+{
+	unsigned int sum = 0;
+	for (IndexNode *node = head; node != NULL; node = node->next)
+		sum += node->key;
+	return sum;
+}
+
+// - Getting an index back after a restart by rebuilding it and by reopening
+//   the file heap it was left in
+void WarmRestart()
+{
+	const int NODES = 1000000;
+	const size_t ARENA = 128 << 20;
+	char const *path = "MemManageBenchmark.heap";
+	remove(path);
+
+	MemManageOptions options;
+	options.backend = ARENA_FILE;
+	options.path = path;
+	{
+		MemManage mem(ARENA, options);
+		BuildIndex(mem, NODES);
+	}
+
+	printf("\nGetting back an index of %d nodes after a restart\n", NODES);
+	printf("%12s %12s %12s\n", "how", "ms", "checksum");
+
+	MemManageOptions heapOptions;
+	heapOptions.allocator = ALLOCATOR_BUDDY;
+	high_resolution_clock::time_point start = high_resolution_clock::now();
+	MemManage *rebuilt = new MemManage(ARENA, heapOptions);
+	unsigned int sum = WalkIndex(BuildIndex(*rebuilt, NODES));
+	double ms = duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000.0;
+	delete rebuilt;
+	printf("%12s %12.2f %12u\n", "rebuild", ms, sum);
+
+	start = high_resolution_clock::now();
+	MemManage *reopened = new MemManage(0, options);
+	sum = WalkIndex((IndexNode*)reopened->Root());
+	ms = duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000.0;
+	delete reopened;
+	printf("%12s %12.2f %12u\n", "reopen", ms, sum);
+	remove(path);
+}
+
+// - Reads every cache line of a buffer, as a consumer would
+static unsigned int Consume(char const *buffer, size_t size)
+{
+	unsigned int sum = 0;
+	for (size_t i = 0; i < size; i += 64)
+		sum += (unsigned char)buffer[i];
+	return sum;
+}
+
+// - Handing buffers from a producer to a consumer through a file, and
+//   through a shared heap by offset. Both heaps are in this process but
+//   map the segment separately, as two processes would.
+void SharedExchange()
+{
+	const int MESSAGES = 256;
+	const size_t SIZE = 1 << 20;
+	char const *path = "MemManageBenchmark.exchange";
+	char const *name = "/MemManageBenchmark.shared";
+
+	printf("\nHanding over %d buffers of 1 MB\n", MESSAGES);
+	printf("%12s %12s %12s\n", "through", "ms", "checksum");
+
+	vector<char> produced(SIZE), consumed(SIZE);
+	unsigned int sum = 0;
+	high_resolution_clock::time_point start = high_resolution_clock::now();
+	for (int i = 0; i < MESSAGES; i++)
+	{
+		memset(&produced[0], i, SIZE);
+		ofstream(path, ios::binary).write(&produced[0], SIZE);
+		ifstream(path, ios::binary).read(&consumed[0], SIZE);
+		sum += Consume(&consumed[0], SIZE);
+	}
+	double ms = duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000.0;
+	remove(path);
+	printf("%12s %12.2f %12u\n", "file", ms, sum);
+
+	MemManage::Unlink(name);
+	MemManageOptions options;
+	options.backend = ARENA_SHARED;
+	options.path = name;
+	options.zeroPolicy = ZERO_NONE;
+	MemManage producer(8 << 20, options);
+	MemManage consumer(0, options);
+	sum = 0;
+	start = high_resolution_clock::now();
+	for (int i = 0; i < MESSAGES; i++)
+	{
+		char *buffer = (char*)producer.Alloc(SIZE);
+		memset(buffer, i, SIZE);
+		char *received = (char*)consumer.Address(producer.Offset(buffer));
+		sum += Consume(received, SIZE);
+		consumer.Free(received);
+	}
+	ms = duration_cast<microseconds>(high_resolution_clock::now() - start).count() / 1000.0;
+	MemManage::Unlink(name);
+	printf("%12s %12.2f %12u\n", "shared heap", ms, sum);
+}
+
+int main()
+{
+	printf("Alloc latency by live block count\n");
+	printf("%12s %12s\n", "live blocks", "ns/alloc");
+	for (int liveBlocks = 1000; liveBlocks <= 64000; liveBlocks *= 4)
+		printf("%12d %12.1f\n", liveBlocks, AllocLatency(liveBlocks));
+
+	printf("\nFree latency by live block count\n");
+	printf("%12s %12s\n", "live blocks", "ns/free");
+	for (int liveBlocks = 1000; liveBlocks <= 64000; liveBlocks *= 4)
+		printf("%12d %12.1f\n", liveBlocks, FreeLatency(liveBlocks));
+
+	FragmentationUnderChurn();
+	CompactionPauses();
+	RelocationThroughput();
+	ZeroingPolicies();
+	LargeArena();
+	ThreadScaling();
+	BuddyVersusFreeList();
+	SlabOverhead();
+	RequestScoped();
+	PeakLoad();
+	StringBuilders();
+	AlignedChurn();
+	BatchAllocation();
+	PlacementPolicies();
+	StatsSnapshots();
+	DumpThroughput();
+	Snapshots();
+	WarmRestart();
+	SharedExchange();
+
+	return 0;
+}
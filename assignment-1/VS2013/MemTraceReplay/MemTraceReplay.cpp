@@ -0,0 +1,231 @@
+#include "..\MemManage\MemManage.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+// A heap a trace can be replayed against
+class ReplayHeap
+{
+public:
+	virtual ~ReplayHeap() {}
+	virtual void* Alloc(size_t size) = 0;
+	virtual void Free(void *ptr) = 0;
+	virtual void* Realloc(void *ptr, size_t size) = 0;
+
+	// - How fragmented free memory is, or a negative number if unknown
+	virtual double Fragmentation() { return -1; }
+};
+
+class MemManageHeap : public ReplayHeap
+{
+private:
+	MemManage mem;
+
+public:
+	MemManageHeap(size_t size, MemManageOptions const &options) : mem(size, options) {}
+	void* Alloc(size_t size) { return mem.Alloc(size); }
+	void Free(void *ptr) { mem.Free(ptr); }
+	void* Realloc(void *ptr, size_t size) { return mem.Realloc(ptr, size); }
+	double Fragmentation() { return mem.Fragmentation(); }
+};
+
+class MallocHeap : public ReplayHeap
+{
+public:
+	void* Alloc(size_t size) { return malloc(size); }
+	void Free(void *ptr) { free(ptr); }
+	void* Realloc(void *ptr, size_t size) { return realloc(ptr, size); }
+};
+
+// - Reads a whole trace into memory so replays time the heap, not the file
+bool LoadTrace(char const *path, vector<TraceEvent> &events)
+{
+	ifstream in(path, ios::binary);
+	TraceReader reader(in);
+	if (!reader.IsValid())
+		return false;
+	TraceEvent event;
+	while (reader.Next(event))
+		events.push_back(event);
+	return true;
+}
+
+// - The most bytes the trace ever has allocated at once
+size_t PeakLiveBytes(vector<TraceEvent> const &events)
+{
+	vector<size_t> sizes;
+	size_t live = 0, peak = 0;
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		TraceEvent const &e = events[i];
+		if (e.id >= sizes.size())
+			sizes.resize(e.id + 1, 0);
+		live -= sizes[e.id];
+		sizes[e.id] = e.op == TRACE_FREE ? 0 : (size_t)e.size;
+		live += sizes[e.id];
+		peak = max(peak, live);
+	}
+	return peak;
+}
+
+// - Replays events against heap and prints a row of throughput, latency
+//   percentiles, failed calls and the worst fragmentation seen. The
+//   fragmentation is sampled between calls, outside the timed region.
+void Replay(char const *name, ReplayHeap &heap, vector<TraceEvent> const &events)
+{
+	const size_t SAMPLE_EVERY = 1024;
+
+	vector<void*> ptrs;
+	vector<unsigned int> latencies;
+	latencies.reserve(events.size());
+	nanoseconds total(0);
+	double peakFragmentation = heap.Fragmentation();
+	int failed = 0;
+
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		TraceEvent const &e = events[i];
+		if (e.id >= ptrs.size())
+			ptrs.resize(e.id + 1, (void*)NULL);
+		void *&ptr = ptrs[e.id];
+		if (e.op != TRACE_ALLOC && ptr == NULL)
+		{
+			// Working on an allocation this heap could not make, so not timed
+			failed++;
+			continue;
+		}
+
+		high_resolution_clock::time_point start = high_resolution_clock::now();
+		void *result = NULL;
+		switch (e.op)
+		{
+		case TRACE_ALLOC:
+			result = ptr = heap.Alloc((size_t)e.size);
+			break;
+		case TRACE_FREE:
+			heap.Free(ptr);
+			ptr = NULL;
+			result = &ptr;
+			break;
+		case TRACE_REALLOC:
+			result = heap.Realloc(ptr, (size_t)e.size);
+			if (result != NULL)
+				ptr = result;
+			break;
+		}
+		nanoseconds elapsed = duration_cast<nanoseconds>(high_resolution_clock::now() - start);
+		total += elapsed;
+		latencies.push_back((unsigned int)min<long long>(elapsed.count(), UINT_MAX));
+		failed += result == NULL;
+
+		if (i % SAMPLE_EVERY == 0)
+			peakFragmentation = max(peakFragmentation, heap.Fragmentation());
+	}
+	for (size_t i = 0; i < ptrs.size(); i++)
+		if (ptrs[i] != NULL)
+			heap.Free(ptrs[i]);
+
+	sort(latencies.begin(), latencies.end());
+	size_t n = latencies.size();
+	double seconds = duration_cast<duration<double>>(total).count();
+	printf("%12s %10.2f %8u %8u %8u %8u %8u %8d ", name, n / seconds / 1e6,
+		latencies[n * 50 / 100], latencies[n * 90 / 100], latencies[n * 99 / 100],
+		latencies[n * 999 / 1000], latencies[n - 1], failed);
+	if (peakFragmentation < 0)
+		printf("%8s\n", "-");
+	else
+		printf("%8.3f\n", peakFragmentation);
+}
+
+// - Records a synthetic trace of short lived small objects, a few long
+//   lived large ones and strings grown by Realloc
+void Record(char const *path, int ops)
+{
+	const int SLOTS = 4000;
+
+	ofstream out(path, ios::binary);
+	TraceWriter writer(out);
+	MemManageOptions options;
+	options.growable = true;
+	MemManage mem(16 << 20, options);
+	mem.SetTrace(&writer);
+
+	vector<void*> slots(SLOTS, (void*)NULL);
+	vector<size_t> sizes(SLOTS, 0);
+	srand(20);
+	for (int op = 0; op < ops; op++)
+	{
+		int slot = rand() % SLOTS;
+		if (slots[slot] == NULL)
+		{
+			sizes[slot] = rand() % 50 == 0 ? 4096 + rand() % 28672 : 8 + rand() % 120;
+			slots[slot] = mem.Alloc(sizes[slot]);
+		}
+		else if (rand() % 4 == 0)
+		{
+			sizes[slot] += sizes[slot] / 2;
+			void *grown = mem.Realloc(slots[slot], sizes[slot]);
+			if (grown != NULL)
+				slots[slot] = grown;
+		}
+		else
+		{
+			mem.Free(slots[slot]);
+			slots[slot] = NULL;
+		}
+	}
+	for (int slot = 0; slot < SLOTS; slot++)
+		if (slots[slot] != NULL)
+			mem.Free(slots[slot]);
+	mem.SetTrace(NULL);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc >= 3 && strcmp(argv[1], "record") == 0)
+	{
+		Record(argv[2], argc >= 4 ? atoi(argv[3]) : 1000000);
+		return 0;
+	}
+	if (argc != 2)
+	{
+		printf("usage: MemTraceReplay <trace>\n");
+		printf("       MemTraceReplay record <trace> [ops]\n");
+		return 1;
+	}
+
+	vector<TraceEvent> events;
+	if (!LoadTrace(argv[1], events) || events.empty())
+	{
+		printf("%s is not a trace\n", argv[1]);
+		return 1;
+	}
+	size_t peak = PeakLiveBytes(events);
+	size_t arena = peak * 2 + (1 << 20);
+	printf("%u events, %u KB peak live, %u KB arena, latencies in ns\n",
+		(unsigned)events.size(), (unsigned)(peak / 1024), (unsigned)(arena / 1024));
+	printf("%12s %10s %8s %8s %8s %8s %8s %8s %8s\n", "heap", "M ops/s",
+		"p50", "p90", "p99", "p99.9", "max", "failed", "frag");
+
+	char const *names[] = { "segregated", "first fit", "next fit", "best fit", "worst fit" };
+	PlacementPolicy policies[] = { PLACE_SEGREGATED, PLACE_FIRST_FIT, PLACE_NEXT_FIT, PLACE_BEST_FIT, PLACE_WORST_FIT };
+	for (int i = 0; i < 5; i++)
+	{
+		MemManageOptions options;
+		options.placement = policies[i];
+		MemManageHeap heap(arena, options);
+		Replay(names[i], heap, events);
+	}
+	MallocHeap system;
+	Replay("malloc", system, events);
+
+	return 0;
+}
@@ -0,0 +1,50 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "..\MemManage\BlockTable.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace UnitTests
+{
+    TEST_CLASS(BlockTableTests)
+    {
+    public:
+        TEST_METHOD(BlockTable_KeepsAddressOrder)
+        {
+            BlockTable t;
+            int a = t.Append(0, 8);
+            int c = t.Append(12, 4);
+            int b = t.InsertAfter(a, 8, 4);
+            t.SetUsed(b, true);
+
+            Assert::AreEqual<int>(3, t.Count());
+            Assert::AreEqual<int>(a, t.First());
+            Assert::AreEqual<int>(b, t.nextBlock[a]);
+            Assert::AreEqual<int>(c, t.nextBlock[b]);
+            Assert::AreEqual<int>(BlockTable::NONE, t.nextBlock[c]);
+            Assert::AreEqual<int>(b, t.prevBlock[c]);
+            Assert::IsTrue(t.IsUsed(b));
+            Assert::IsFalse(t.IsUsed(a));
+        }
+
+        TEST_METHOD(BlockTable_ReusesRemovedRows)
+        {
+            BlockTable t;
+            int a = t.Append(0, 8);
+            int b = t.Append(8, 8);
+            t.SetUsed(b, true);
+            t.SetFixed(b, true);
+            t.Remove(b);
+            Assert::AreEqual<int>(1, t.Count());
+            Assert::AreEqual<int>(BlockTable::NONE, t.nextBlock[a]);
+
+            // A reused row starts out unused and unfixed
+            int c = t.InsertAfter(a, 8, 8);
+            Assert::AreEqual<int>(b, c);
+            Assert::IsFalse(t.IsUsed(c));
+            Assert::IsFalse(t.IsFixed(c));
+            Assert::AreEqual<size_t>(2, t.offset.size());
+        }
+    };
+}
@@ -1,6 +1,10 @@
 #include "stdafx.h"
 #include "CppUnitTest.h"
 #include "..\MemManage\MemManage.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
 
 #define MEM_SIZE 16
 
@@ -15,13 +19,13 @@ namespace UnitTests
         TEST_METHOD(MemManage_AllocatesMemory)
         {
             MemManage m(MEM_SIZE);
-            Assert::AreEqual<int>(MEM_SIZE, m.Avail());
+            Assert::AreEqual<size_t>(MEM_SIZE, m.Avail());
 
             stringstream sstream;
             int *intPtr = (int*)m.Alloc(sizeof(int));
             float *floatPtr = (float*)m.Alloc(sizeof(float));
 
-            Assert::AreEqual<int>(MEM_SIZE - sizeof(int) - sizeof(float), m.Avail());
+            Assert::AreEqual<size_t>(MEM_SIZE - sizeof(int) - sizeof(float), m.Avail());
             Assert::IsNotNull(intPtr);
             Assert::IsNotNull(floatPtr);
 
@@ -47,7 +51,7 @@ namespace UnitTests
 
             Assert::IsNotNull(intPtr);
             Assert::IsNotNull(floatPtr);
-			Assert::AreEqual<int>(MEM_SIZE - sizeof(int)-sizeof(float), m.Avail());
+			Assert::AreEqual<size_t>(MEM_SIZE - sizeof(int)-sizeof(float), m.Avail());
 
             *intPtr = 10;
             *floatPtr = 1.2f;
@@ -59,7 +63,7 @@ namespace UnitTests
 			sstream.str("");
 
             m.Free(intPtr);
-            Assert::AreEqual<int>(MEM_SIZE - sizeof(int), m.Avail());
+            Assert::AreEqual<size_t>(MEM_SIZE - sizeof(int), m.Avail());
             sstream << m;
             Assert::AreEqual<basic_string<char>>(
                 "00 00 00 00 9A 99 99 3F 00 00 00 00 00 00 00 00\n",
@@ -67,7 +71,7 @@ namespace UnitTests
 			sstream.str("");
 
             m.Free(floatPtr);
-            Assert::AreEqual<int>(MEM_SIZE, m.Avail());
+            Assert::AreEqual<size_t>(MEM_SIZE, m.Avail());
             sstream << m;
             Assert::AreEqual<basic_string<char>>(
                 "00 00 00 00 00 00 00 00 00 00 00 00 00 00 00 00\n",
@@ -78,11 +82,11 @@ namespace UnitTests
 			b = (char*)m.Alloc(2);
 			c = (char*)m.Alloc(4);
 
-			Assert::AreEqual<int>(0, m.Avail());
+			Assert::AreEqual<size_t>(0, m.Avail());
 			m.Free(b);
-			Assert::AreEqual<int>(2, m.Avail());
+			Assert::AreEqual<size_t>(2, m.Avail());
 			m.Free(c);
-			Assert::AreEqual<int>(6, m.Avail());
+			Assert::AreEqual<size_t>(6, m.Avail());
         }
 
 		TEST_METHOD(MemManage_ReallocatesMemory)
@@ -125,7 +129,7 @@ namespace UnitTests
 				sprintf_s(ptrs[i], len, strs[i]);
 			}
 
-			Assert::AreEqual<int>(0, m.Avail());
+			Assert::AreEqual<size_t>(0, m.Avail());
 
             sstream << m;
             Assert::AreEqual<basic_string<char>>(
@@ -149,7 +153,7 @@ namespace UnitTests
 				"6F 6E 65 00 74 77 6F 00 6B 00 00 00 00 00 00 00\n",
 				sstream.str(), L"3");
 			sstream.str("");
-			Assert::AreEqual<int>(6, m.Avail());
+			Assert::AreEqual<size_t>(6, m.Avail());
 
 			cpy.Compact();
             sstream << cpy;
@@ -157,7 +161,7 @@ namespace UnitTests
 				"6F 6E 65 00 74 77 6F 00 6B 00 00 00 00 00 00 00\n",
 				sstream.str(), L"4");
 			sstream.str("");
-			Assert::AreEqual<int>(6, cpy.Avail());
+			Assert::AreEqual<size_t>(6, cpy.Avail());
 
             sstream << m;
             Assert::AreEqual<basic_string<char>>(
@@ -170,21 +174,1138 @@ namespace UnitTests
 			MemManage m(16), cpy(m);
 			stringstream s1, s2;
 
-			Assert::AreEqual<int>(16, m.Avail());
-			Assert::AreEqual<int>(16, cpy.Avail());
+			Assert::AreEqual<size_t>(16, m.Avail());
+			Assert::AreEqual<size_t>(16, cpy.Avail());
 			
 			char* str = (char*)m.Alloc(6);
-			Assert::AreEqual<int>(10, m.Avail());
-			Assert::AreEqual<int>(16, cpy.Avail());
+			Assert::AreEqual<size_t>(10, m.Avail());
+			Assert::AreEqual<size_t>(16, cpy.Avail());
 			sprintf_s(str, 6, "hello");
 
 			cpy = m;
-			Assert::AreEqual<int>(10, m.Avail());
-			Assert::AreEqual<int>(10, cpy.Avail());
+			Assert::AreEqual<size_t>(10, m.Avail());
+			Assert::AreEqual<size_t>(10, cpy.Avail());
 
 			s1 << m;
 			s2 << cpy;
 			Assert::AreEqual<basic_string<char>>(s1.str(), s2.str());
 		}
+
+		TEST_METHOD(MemManage_AllocReusesFreedBlockOfSameSize)
+		{
+			MemManage m(64);
+			char *a = (char*)m.Alloc(20);
+			char *x = (char*)m.Alloc(4);
+			char *b = (char*)m.Alloc(4);
+			char *y = (char*)m.Alloc(4);
+
+			m.Free(a);
+			m.Free(b);
+			Assert::AreEqual<size_t>(56, m.Avail());
+
+			// Each request is served from the bin of its size class rather
+			// than the first block large enough
+			Assert::IsTrue(m.Alloc(4) == b);
+			Assert::IsTrue(m.Alloc(20) == a);
+			Assert::AreEqual<size_t>(32, m.Avail());
+			Assert::IsTrue(a < x && x < b && b < y);
+		}
+
+		TEST_METHOD(MemManage_AllocMergesFragments)
+		{
+			MemManage m(MEM_SIZE);
+			void *ptrs[4];
+			for (int i = 0; i < 4; i++)
+				ptrs[i] = m.Alloc(4);
+			Assert::IsNull(m.Alloc(1));
+
+			for (int i = 0; i < 4; i++)
+				m.Free(ptrs[i]);
+
+			// The freed fragments merge back into a single block
+			Assert::IsTrue(m.Alloc(MEM_SIZE) == ptrs[0]);
+			Assert::AreEqual<size_t>(0, m.Avail());
+		}
+
+		TEST_METHOD(MemManage_FreeIgnoresUnknownPointers)
+		{
+			MemManage m(MEM_SIZE);
+			char *a = (char*)m.Alloc(8);
+			char *b = (char*)m.Alloc(8);
+			int outside;
+
+			m.Free(a + 1);
+			m.Free(&outside);
+			m.Free(NULL);
+			Assert::AreEqual<size_t>(0, m.Avail());
+			Assert::IsNull(m.Realloc(a + 1, 4));
+
+			m.Free(b);
+			m.Free(b);
+			Assert::AreEqual<size_t>(8, m.Avail());
+			Assert::IsNull(m.Realloc(b, 4));
+		}
+
+		TEST_METHOD(MemManage_FreeCoalescesNeighbours)
+		{
+			MemManage m(MEM_SIZE);
+			void *a = m.Alloc(4);
+			void *b = m.Alloc(4);
+			void *c = m.Alloc(4);
+			void *d = m.Alloc(4);
+
+			m.Free(a);
+			m.Free(c);
+			Assert::AreEqual<size_t>(4, m.LargestFree());
+			Assert::AreEqual(0.5, m.Fragmentation(), 0.001);
+
+			// b merges with both a and c, leaving one block of 12
+			m.Free(b);
+			Assert::AreEqual<size_t>(12, m.LargestFree());
+			Assert::AreEqual(0.0, m.Fragmentation(), 0.001);
+			Assert::IsTrue(m.Alloc(12) == a);
+
+			m.Free(a);
+			m.Free(d);
+			Assert::AreEqual<size_t>(MEM_SIZE, m.LargestFree());
+		}
+
+		TEST_METHOD(MemManage_CompactRelocatesHandles)
+		{
+			MemManage m(MEM_SIZE);
+			MemHandle a = m.AllocHandle(6);
+			MemHandle b = m.AllocHandle(6);
+			Assert::AreNotEqual<int>(0, a);
+			Assert::AreNotEqual<int>(0, b);
+			void *start = m.Resolve(a);
+			sprintf_s((char*)m.Resolve(b), 6, "hello");
+
+			m.FreeHandle(a);
+			Assert::IsNull(m.Resolve(a));
+			m.Compact();
+
+			// b's memory moved to the start of the arena with its contents
+			Assert::IsTrue(m.Resolve(b) == start);
+			Assert::AreEqual<basic_string<char>>("hello", (char*)m.Resolve(b));
+			Assert::AreEqual<size_t>(MEM_SIZE - 6, m.LargestFree());
+
+			m.FreeHandle(b);
+			Assert::AreEqual<size_t>(MEM_SIZE, m.Avail());
+		}
+
+		TEST_METHOD(MemManage_CompactKeepsPinnedHandles)
+		{
+			MemManage m(MEM_SIZE);
+			char *raw = (char*)m.Alloc(4);
+			MemHandle pinned = m.AllocHandle(4);
+			char *spare = (char*)m.Alloc(4);
+			MemHandle moved = m.AllocHandle(4);
+			sprintf_s((char*)m.Resolve(moved), 4, "abc");
+
+			char *pinnedPtr = (char*)m.Pin(pinned);
+			m.Free(raw);
+			m.Free(spare);
+			m.Compact();
+
+			// The pinned block holds its place, so the gap before it survives
+			Assert::IsTrue(m.Resolve(pinned) == pinnedPtr);
+			Assert::IsTrue(m.Resolve(moved) == pinnedPtr + 4);
+			Assert::AreEqual<basic_string<char>>("abc", (char*)m.Resolve(moved));
+			Assert::AreEqual<size_t>(8, m.Avail());
+			Assert::AreEqual<size_t>(4, m.LargestFree());
+
+			m.Unpin(pinned);
+			m.Compact();
+			Assert::IsTrue(m.Resolve(pinned) == raw);
+			Assert::IsTrue(m.Resolve(moved) == raw + 4);
+			Assert::AreEqual<size_t>(8, m.LargestFree());
+		}
+
+		TEST_METHOD(MemManage_CompactStepMovesBoundedAmount)
+		{
+			MemManage m(48);
+			MemHandle handles[4];
+			void *first = m.Alloc(8);
+			for (int i = 0; i < 4; i++)
+			{
+				handles[i] = m.AllocHandle(8);
+				sprintf_s((char*)m.Resolve(handles[i]), 8, "block %d", i);
+			}
+			char *raw = (char*)m.Alloc(8);
+			sprintf_s(raw, 8, "raw");
+			m.Free(first);
+
+			// Each step's budget only covers moving one block
+			Assert::IsFalse(m.CompactStep(12));
+			Assert::IsTrue(m.Resolve(handles[0]) == first);
+			Assert::IsTrue(m.Resolve(handles[1]) == (char*)first + 16);
+
+			int steps = 1;
+			while (!m.CompactStep(12))
+				steps++;
+			Assert::IsTrue(steps >= 4);
+
+			for (int i = 0; i < 4; i++)
+			{
+				char expected[8];
+				sprintf_s(expected, 8, "block %d", i);
+				Assert::IsTrue(m.Resolve(handles[i]) == (char*)first + 8 * i);
+				Assert::AreEqual<basic_string<char>>(expected, (char*)m.Resolve(handles[i]));
+			}
+
+			// The raw allocation is never moved, so the freed space sits
+			// just in front of it
+			Assert::AreEqual<basic_string<char>>("raw", raw);
+			Assert::AreEqual<size_t>(8, m.LargestFree());
+			Assert::IsTrue(m.Alloc(8) == (char*)first + 32);
+		}
+
+		TEST_METHOD(MemManage_CompactMovesRunsOfBlocks)
+		{
+			MemManage m(MEM_SIZE);
+			stringstream sstream;
+			char *ptrs[6];
+			for (int i = 0; i < 6; i++)
+			{
+				ptrs[i] = (char*)m.Alloc(2);
+				ptrs[i][0] = ptrs[i][1] = (char)(0x11 * (i + 1));
+			}
+			m.Free(ptrs[0]);
+			m.Free(ptrs[3]);
+
+			m.Compact();
+			sstream << m;
+			Assert::AreEqual<basic_string<char>>(
+				"22 22 33 33 55 55 66 66 00 00 00 00 00 00 00 00\n",
+				sstream.str());
+		}
+
+		TEST_METHOD(MemManage_ZeroNone)
+		{
+			MemManageOptions options;
+			options.zeroPolicy = ZERO_NONE;
+			MemManage m(8, options);
+			stringstream sstream;
+
+			char *a = (char*)m.Alloc(4);
+			char *b = (char*)m.Alloc(4);
+			sprintf_s(a, 4, "abc");
+			sprintf_s(b, 4, "xyz");
+			m.Free(a);
+
+			// Freed memory keeps its contents, and so does memory that
+			// Compact moves out of
+			sstream << m;
+			Assert::AreEqual<basic_string<char>>("61 62 63 00 78 79 7A 00", sstream.str());
+			sstream.str("");
+
+			m.Compact();
+			sstream << m;
+			Assert::AreEqual<basic_string<char>>("78 79 7A 00 78 79 7A 00", sstream.str());
+		}
+
+		TEST_METHOD(MemManage_ZeroOnAlloc)
+		{
+			MemManageOptions options;
+			options.zeroPolicy = ZERO_ON_ALLOC;
+			MemManage m(8, options);
+
+			char *a = (char*)m.Alloc(8);
+			memset(a, 0xFF, 8);
+			m.Free(a);
+			Assert::AreEqual<int>(0xFF, (unsigned char)a[7]);
+
+			char *b = (char*)m.Alloc(2);
+			b = (char*)m.Realloc(b, 7);
+			Assert::IsNotNull(b);
+			for (int i = 0; i < 7; i++)
+				Assert::AreEqual<int>(0, b[i]);
+		}
+
+		TEST_METHOD(MemManage_ZeroLazy)
+		{
+			MemManageOptions options;
+			options.zeroPolicy = ZERO_LAZY;
+			MemManage m(MEM_SIZE, options);
+			stringstream sstream;
+
+			char *a = (char*)m.Alloc(4);
+			memset(a, 0xFF, 4);
+			m.Free(a);
+			sstream << m;
+			Assert::AreEqual<basic_string<char>>(
+				"FF FF FF FF 00 00 00 00 00 00 00 00 00 00 00 00\n",
+				sstream.str());
+
+			// Reused memory is nulled on the way out, fresh memory already is
+			char *b = (char*)m.Alloc(8);
+			Assert::IsTrue(a == b);
+			for (int i = 0; i < 8; i++)
+				Assert::AreEqual<int>(0, b[i]);
+		}
+
+		TEST_METHOD(MemManage_PageBackedArena)
+		{
+			MemManageOptions options;
+			options.backend = ARENA_PAGES;
+			MemManage m(MEM_SIZE, options);
+
+			char *a = (char*)m.Alloc(4);
+			char *b = (char*)m.Alloc(4);
+			memset(b, 0x22, 4);
+			m.Free(a);
+			m.Compact();
+			Assert::IsNotNull(m.Alloc(12));
+
+			// Copies get their own mapping
+			MemManage copy(m);
+			stringstream original, copied;
+			original << m;
+			copied << copy;
+			Assert::AreEqual<basic_string<char>>(original.str(), copied.str());
+			Assert::AreEqual<basic_string<char>>(
+				"22 22 22 22 00 00 00 00 00 00 00 00 00 00 00 00\n",
+				copied.str());
+		}
+
+		TEST_METHOD(MemManage_CompactDiscardsTailPages)
+		{
+			const int ARENA = 1 << 20;
+			MemManageOptions options;
+			options.zeroPolicy = ZERO_NONE;
+			options.backend = ARENA_PAGES;
+			MemManage m(ARENA, options);
+
+			MemHandle h = m.AllocHandle(16);
+			char *a = (char*)m.Alloc(ARENA / 2);
+			memset(a, 0xFF, ARENA / 2);
+			m.Free(a);
+			memset(m.Resolve(h), 0x11, 16);
+
+			// Nothing nulls freed memory under ZERO_NONE, so the tail only
+			// reads as null if its pages really went back to the OS
+			m.Compact();
+			char *b = (char*)m.Alloc(ARENA - 16);
+			Assert::IsNotNull(b);
+			Assert::AreEqual<int>(0x11, ((char*)m.Resolve(h))[15]);
+			for (int i = ARENA / 4; i < ARENA / 2; i++)
+				Assert::AreEqual<int>(0, b[i]);
+		}
+
+		TEST_METHOD(MemManage_ArenaOver4GB)
+		{
+			// Only 64 bit builds can address an arena this large
+			if (sizeof(size_t) < 8)
+				return;
+
+			const size_t GB = (size_t)1 << 30;
+			MemManageOptions options;
+			options.zeroPolicy = ZERO_NONE;
+			options.backend = ARENA_PAGES;
+			MemManage m(6 * GB, options);
+			Assert::AreEqual<size_t>(6 * GB, m.Total());
+
+			char *a = (char*)m.Alloc(3 * GB);
+			char *b = (char*)m.Alloc(2 * GB + 1);
+			Assert::IsNotNull(a);
+			Assert::IsTrue(b == a + 3 * GB);
+			b[2 * GB] = 0x5A;
+			Assert::AreEqual<size_t>(GB - 1, m.Avail());
+			Assert::IsNull(m.Alloc(GB));
+
+			// Sizes past 4 GB must not wrap when blocks are freed and merged
+			m.Free(a);
+			Assert::AreEqual<size_t>(4 * GB - 1, m.Avail());
+			Assert::AreEqual<size_t>(3 * GB, m.LargestFree());
+			Assert::IsTrue(b == m.Realloc(b, 2 * GB));
+			Assert::AreEqual<size_t>(4 * GB, m.Avail());
+			m.Free(b);
+			Assert::AreEqual<size_t>(6 * GB, m.LargestFree());
+			Assert::IsTrue(a == m.Alloc(5 * GB));
+		}
+
+		TEST_METHOD(MemManage_ThreadSafeCachesSmallBlocks)
+		{
+			const int ARENA = 1 << 20;
+			MemManageOptions options;
+			options.threadSafe = true;
+			MemManage m(ARENA, options);
+
+			// Small blocks come out of one span, carved from the heap in one go
+			char *a = (char*)m.Alloc(40);
+			char *b = (char*)m.Alloc(40);
+			Assert::IsNotNull(a);
+			Assert::IsTrue(b > a && b - a >= 40);
+			size_t avail = m.Avail();
+			memset(a, 0x33, 40);
+			m.Free(a);
+			Assert::IsTrue(a == m.Alloc(44));
+			Assert::AreEqual<int>(0, a[0]);
+			Assert::AreEqual<size_t>(avail, m.Avail());
+
+			// Growing past the size class moves the block
+			char *c = (char*)m.Realloc(b, 2000);
+			Assert::IsTrue(c != b);
+			Assert::AreEqual<size_t>(avail - 2000, m.Avail());
+
+			m.Free(a);
+			m.Free(c);
+			m.ReleaseThreadCache();
+			Assert::AreEqual<size_t>(ARENA, m.Avail());
+			Assert::AreEqual<size_t>(ARENA, m.LargestFree());
+		}
+
+		TEST_METHOD(MemManage_ThreadSafeRemoteFrees)
+		{
+			const int BLOCKS = 1000;
+			MemManageOptions options;
+			options.threadSafe = true;
+			MemManage m(1 << 20, options);
+
+			vector<void*> blocks(BLOCKS);
+			for (int i = 0; i < BLOCKS; i++)
+				blocks[i] = m.Alloc(24);
+			size_t avail = m.Avail();
+
+			// Frees from another thread are reclaimed by the allocating thread
+			thread freer([&]()
+			{
+				for (int i = 0; i < BLOCKS; i++)
+					m.Free(blocks[i]);
+			});
+			freer.join();
+			for (int i = 0; i < BLOCKS; i++)
+				Assert::IsNotNull(m.Alloc(24));
+			Assert::AreEqual<size_t>(avail, m.Avail());
+		}
+
+		TEST_METHOD(MemManage_ThreadSafeConcurrentChurn)
+		{
+			const int ARENA = 16 << 20;
+			const int THREADS = 4;
+			const int OPS = 20000;
+			MemManageOptions options;
+			options.threadSafe = true;
+			MemManage m(ARENA, options);
+
+			// Every block is filled with its size and checked before it is
+			// freed. Some blocks are passed through a mailbox so another thread
+			// frees them.
+			vector<pair<char*, int> > mailbox;
+			mutex mailboxLock;
+			vector<int> corrupt(THREADS, 0);
+			vector<thread> threads;
+			for (int t = 0; t < THREADS; t++)
+			{
+				threads.push_back(thread([&, t]()
+				{
+					vector<pair<char*, int> > live;
+					unsigned int seed = t + 1;
+					for (int op = 0; op < OPS; op++)
+					{
+						seed = seed * 1103515245 + 12345;
+						int random = (int)(seed >> 8);
+						if (live.size() < 64 && random % 3 != 0)
+						{
+							int size = 1 + (op % 50 == 0 ? random % 4000 : random % 300);
+							char *ptr = (char*)m.Alloc(size);
+							if (ptr == NULL)
+								continue;
+							memset(ptr, (char)size, size);
+							live.push_back(make_pair(ptr, size));
+							continue;
+						}
+						if (live.empty())
+							continue;
+
+						int i = random % live.size();
+						pair<char*, int> block = live[i];
+						live[i] = live.back();
+						live.pop_back();
+						if (random % 4 == 0)
+						{
+							lock_guard<mutex> guard(mailboxLock);
+							if (mailbox.size() < 16)
+							{
+								mailbox.push_back(block);
+								continue;
+							}
+							swap(block, mailbox[random % mailbox.size()]);
+						}
+						for (int j = 0; j < block.second; j++)
+							corrupt[t] += block.first[j] != (char)block.second;
+						m.Free(block.first);
+					}
+					for (size_t i = 0; i < live.size(); i++)
+						m.Free(live[i].first);
+					m.ReleaseThreadCache();
+				}));
+			}
+			for (int t = 0; t < THREADS; t++)
+				threads[t].join();
+
+			for (size_t i = 0; i < mailbox.size(); i++)
+				m.Free(mailbox[i].first);
+			m.ReleaseThreadCache();
+			for (int t = 0; t < THREADS; t++)
+				Assert::AreEqual<int>(0, corrupt[t]);
+			Assert::AreEqual<size_t>(ARENA, m.Avail());
+		}
+
+		TEST_METHOD(MemManage_SlabsServeSmallBlocks)
+		{
+			const int ARENA = 1 << 20;
+			const int SLAB = 64 << 10;
+			MemManageOptions options;
+			options.slabs = true;
+			MemManage m(ARENA, options);
+
+			// Objects of a size class sit back to back in one slab carved
+			// from the arena, larger blocks still come from the block table
+			char *a = (char*)m.Alloc(40);
+			char *b = (char*)m.Alloc(44);
+			Assert::IsTrue(b == a + 47);
+			Assert::AreEqual<size_t>(ARENA - SLAB, m.Avail());
+			char *large = (char*)m.Alloc(400);
+			Assert::IsTrue(large < a || large >= a + SLAB);
+			Assert::AreEqual<size_t>(ARENA - SLAB - 400, m.Avail());
+
+			// Freed slots are reused straight away and come back nulled
+			memset(a, 0x44, 40);
+			m.Free(a);
+			char *c = (char*)m.Alloc(41);
+			Assert::IsTrue(c == a);
+			for (int i = 0; i < 41; i++)
+				Assert::AreEqual<int>(0, c[i]);
+
+			// Growing past the size class moves the block out of the slab
+			memset(b, 0x55, 44);
+			char *d = (char*)m.Realloc(b, 400);
+			Assert::IsTrue(d < a || d >= a + SLAB);
+			Assert::AreEqual<int>(0x55, d[43]);
+			Assert::AreEqual<int>(0, d[44]);
+		}
+
+		TEST_METHOD(MemManage_SlabReallocZeroes)
+		{
+			MemManageOptions options;
+			options.slabs = true;
+			options.zeroPolicy = ZERO_ON_ALLOC;
+			MemManage m(1 << 20, options);
+
+			// Shrinking then growing back in place shows nulls where the old
+			// contents were, as it does for blocks
+			char *a = (char*)m.Alloc(40);
+			memset(a, 0xAB, 40);
+			Assert::IsTrue(a == m.Realloc(a, 8));
+			Assert::IsTrue(a == m.Realloc(a, 40));
+			Assert::AreEqual<int>(0xAB, (unsigned char)a[7]);
+			for (int i = 8; i < 40; i++)
+				Assert::AreEqual<int>(0, a[i]);
+
+			// Moving out of the slab brings only the live part along
+			memset(a, 0xCD, 8);
+			Assert::IsTrue(a == m.Realloc(a, 8));
+			char *b = (char*)m.Realloc(a, 400);
+			Assert::AreEqual<int>(0xCD, (unsigned char)b[7]);
+			for (int i = 8; i < 400; i++)
+				Assert::AreEqual<int>(0, b[i]);
+		}
+
+		TEST_METHOD(MemManage_SlabsIgnoreDoubleFree)
+		{
+			for (int threadSafe = 0; threadSafe < 2; threadSafe++)
+			{
+				MemManageOptions options;
+				options.slabs = true;
+				options.threadSafe = threadSafe != 0;
+				MemManage m(1 << 20, options);
+
+				// A second Free of an object leaves it off the free list, so
+				// it is handed out once
+				char *a = (char*)m.Alloc(16);
+				m.Free(a);
+				m.Free(a);
+				char *b = (char*)m.Alloc(16);
+				char *c = (char*)m.Alloc(16);
+				Assert::IsTrue(b != c);
+
+				// The same goes for a batch naming an object twice, and for
+				// objects never handed out
+				void *batch[3] = { b, b, c + 16 };
+				m.FreeBatch(batch, 3);
+				Assert::IsTrue(m.Alloc(16) != m.Alloc(16));
+				Assert::AreEqual<size_t>(3, m.Stats().liveBlocks);
+			}
+		}
+
+		TEST_METHOD(MemManage_BuddySplitsAndMerges)
+		{
+			MemManageOptions options;
+			options.allocator = ALLOCATOR_BUDDY;
+			MemManage m(256, options);
+
+			// Sizes round up to a power of two, each split keeping the lower half
+			char *a = (char*)m.Alloc(20);
+			char *b = (char*)m.Alloc(16);
+			char *c = (char*)m.Alloc(100);
+			Assert::IsTrue(b == a + 32);
+			Assert::IsTrue(c == a + 128);
+			Assert::AreEqual<size_t>(256 - 32 - 16 - 128, m.Avail());
+			Assert::AreEqual<size_t>(64, m.LargestFree());
+			Assert::IsNull(m.Alloc(65));
+
+			// Freeing a's buddy alone merges nothing, freeing both brings
+			// back the whole lower half
+			m.Free(b);
+			Assert::AreEqual<size_t>(64, m.LargestFree());
+			m.Free(a);
+			Assert::AreEqual<size_t>(128, m.LargestFree());
+			Assert::IsTrue(a == m.Alloc(128));
+			m.Free(a);
+			m.Free(c);
+			Assert::AreEqual<size_t>(256, m.LargestFree());
+			Assert::AreEqual<size_t>(256, m.Avail());
+		}
+
+		TEST_METHOD(MemManage_BuddyReallocAndZeroing)
+		{
+			MemManageOptions options;
+			options.allocator = ALLOCATOR_BUDDY;
+			MemManage m(100, options);
+
+			// 100 bytes is managed as blocks of 64 and 32, the last 4 unused
+			Assert::AreEqual<size_t>(96, m.Avail());
+			Assert::AreEqual<size_t>(64, m.LargestFree());
+
+			// Blocks grow in place up to their power of two size
+			char *a = (char*)m.Alloc(10);
+			memset(a, 0x33, 10);
+			Assert::IsTrue(a == m.Realloc(a, 16));
+			char *b = (char*)m.Realloc(a, 17);
+			Assert::IsNotNull(b);
+			Assert::IsTrue(b != a);
+			Assert::AreEqual<int>(0x33, b[9]);
+			Assert::AreEqual<int>(0, b[10]);
+
+			// Freed memory is nulled, free list links included once reused
+			m.Free(b);
+			Assert::AreEqual<size_t>(96, m.Avail());
+			char *c = (char*)m.Alloc(64);
+			for (int i = 0; i < 64; i++)
+				Assert::AreEqual<int>(0, c[i]);
+
+			// Copies get their own free lists
+			MemManage copy(m);
+			Assert::IsNotNull(copy.Alloc(32));
+			Assert::IsNull(copy.Alloc(16));
+			Assert::IsNotNull(m.Alloc(16));
+			Assert::AreEqual<MemHandle>(0, m.AllocHandle(16));
+		}
+
+		TEST_METHOD(MemManage_RegionMarkAndReset)
+		{
+			MemManageOptions options;
+			options.allocator = ALLOCATOR_REGION;
+			MemManage m(MEM_SIZE, options);
+
+			// Allocations are bumped off the top one after another
+			char *a = (char*)m.Alloc(4);
+			RegionMark mark = m.Mark();
+			char *b = (char*)m.Alloc(6);
+			Assert::IsTrue(b == a + 4);
+			Assert::AreEqual<size_t>(MEM_SIZE - 10, m.Avail());
+			memset(b, 0x66, 6);
+
+			// Only the latest allocation can be resized, and Free does nothing
+			Assert::IsTrue(b == m.Realloc(b, 8));
+			Assert::IsNull(m.Realloc(a, 8));
+			m.Free(b);
+			Assert::AreEqual<size_t>(MEM_SIZE - 12, m.Avail());
+			Assert::IsNull(m.Alloc(5));
+
+			// Everything after the mark goes at once, nulled under ZERO_ON_FREE
+			m.ResetTo(mark);
+			Assert::AreEqual<size_t>(MEM_SIZE - 4, m.Avail());
+			char *c = (char*)m.Alloc(12);
+			Assert::IsTrue(c == b);
+			for (int i = 0; i < 12; i++)
+				Assert::AreEqual<int>(0, c[i]);
+
+			m.Reset();
+			Assert::AreEqual<size_t>(MEM_SIZE, m.Avail());
+			Assert::IsTrue(a == m.Alloc(MEM_SIZE));
+			Assert::AreEqual<MemHandle>(0, m.AllocHandle(1));
+
+			// Taking a mark stops what came before it growing across it, or
+			// ResetTo would hand the same memory out twice
+			MemManage r(256, options);
+			char *d = (char*)r.Alloc(32);
+			mark = r.Mark();
+			Assert::IsNull(r.Realloc(d, 64));
+			r.ResetTo(mark);
+			char *e = (char*)r.Alloc(32);
+			Assert::IsTrue(e >= d + 32);
+		}
+
+		TEST_METHOD(MemManage_GrowsIntoChunks)
+		{
+			MemManageOptions options;
+			options.growable = true;
+			MemManage m(64, options);
+
+			// A full arena chains a chunk twice its size, or twice the
+			// allocation if that is larger
+			char *a = (char*)m.Alloc(48);
+			char *b = (char*)m.Alloc(40);
+			Assert::IsNotNull(b);
+			Assert::IsTrue(b < a || b >= a + 64);
+			Assert::AreEqual<size_t>(64 + 128, m.Total());
+			Assert::AreEqual<size_t>(16 + 88, m.Avail());
+			char *c = (char*)m.Alloc(200);
+			Assert::AreEqual<size_t>(64 + 128 + 400, m.Total());
+
+			// Frees find the owning chunk, memory that cannot grow in place
+			// moves to whichever chunk has room
+			m.Free(b);
+			Assert::AreEqual<size_t>(16 + 128 + 200, m.Avail());
+			memset(a, 0x77, 48);
+			char *d = (char*)m.Realloc(a, 100);
+			Assert::IsTrue(d == c + 200);
+			Assert::AreEqual<int>(0x77, d[47]);
+			Assert::AreEqual<int>(0, d[48]);
+			Assert::AreEqual<size_t>(64 + 128 + 100, m.Avail());
+			Assert::AreEqual<size_t>(128, m.LargestFree());
+
+			// Copies get their own chunks
+			MemManage copy(m);
+			stringstream original, copied;
+			original << m;
+			copied << copy;
+			Assert::AreEqual<basic_string<char>>(original.str(), copied.str());
+			copy.Free(copy.Alloc(300));
+			Assert::AreEqual<size_t>(64 + 128 + 400, m.Total());
+		}
+
+		TEST_METHOD(MemManage_ReallocAbsorbsExactFit)
+		{
+			MemManage m(MEM_SIZE);
+			char *a = (char*)m.Alloc(4);
+			char *b = (char*)m.Alloc(4);
+			m.Alloc(8);
+			m.Free(b);
+
+			// The free block after a is exactly the growth needed
+			Assert::IsTrue(a == m.Realloc(a, 8));
+			Assert::AreEqual<size_t>(0, m.Avail());
+			Assert::IsNull(m.Alloc(1));
+		}
+
+		TEST_METHOD(MemManage_ReallocSlidesIntoPrevious)
+		{
+			MemManage m(32);
+			char *a = (char*)m.Alloc(8);
+			char *b = (char*)m.Alloc(8);
+			char *c = (char*)m.Alloc(8);
+			char *d = (char*)m.Alloc(8);
+			memset(b, 0xBB, 8);
+			memset(d, 0xDD, 8);
+			m.Free(a);
+			m.Free(c);
+
+			// Neither neighbour is big enough alone, together they are
+			Assert::IsTrue(a == m.Realloc(b, 20));
+			Assert::AreEqual<size_t>(4, m.Avail());
+			stringstream sstream;
+			sstream << m;
+			Assert::AreEqual<basic_string<char>>(
+				"BB BB BB BB BB BB BB BB 00 00 00 00 00 00 00 00\n"
+				"00 00 00 00 00 00 00 00 DD DD DD DD DD DD DD DD\n",
+				sstream.str());
+			Assert::IsTrue(a + 20 == m.Alloc(4));
+		}
+
+		TEST_METHOD(MemManage_AllocAligned)
+		{
+			MemManage m(1024);
+			char *a = (char*)m.Alloc(3);
+
+			// The default alignment follows the size
+			char *b = (char*)m.AllocAligned(100);
+			char *d = (char*)m.AllocAligned(8);
+			char *c = (char*)m.AllocAligned(40);
+			Assert::AreEqual<size_t>(0, (size_t)b % 64);
+			Assert::AreEqual<size_t>(0, (size_t)c % 32);
+			Assert::AreEqual<size_t>(0, (size_t)d % 16);
+			Assert::AreEqual<size_t>(0, (size_t)m.AllocAligned(1, 256) % 256);
+			Assert::IsNull(m.AllocAligned(8, 24));
+
+			// Padding left in front of an aligned block is reused, first by
+			// aligned blocks that fit in it
+			Assert::IsTrue(b == a + 64);
+			Assert::IsTrue(d == a + 16);
+			Assert::IsTrue(a + 3 == m.Alloc(13));
+		}
+
+		TEST_METHOD(MemManage_AllocAlignedOtherAllocators)
+		{
+			MemManageOptions options;
+			options.allocator = ALLOCATOR_REGION;
+			MemManage region(256, options);
+			char *a = (char*)region.Alloc(5);
+			char *b = (char*)region.AllocAligned(16, 32);
+			Assert::AreEqual<size_t>(0, (size_t)b % 32);
+			Assert::IsTrue(b == a + 32);
+			Assert::AreEqual<size_t>(256 - 48, region.Avail());
+
+			options.allocator = ALLOCATOR_BUDDY;
+			MemManage buddy(256, options);
+			buddy.Alloc(16);
+			char *c = (char*)buddy.AllocAligned(16, 64);
+			Assert::AreEqual<size_t>(0, (size_t)c % 64);
+			Assert::AreEqual<size_t>(256 - 16 - 64, buddy.Avail());
+		}
+
+		TEST_METHOD(MemManage_BuddyAlignsPastItsArena)
+		{
+			MemManageOptions options;
+			options.allocator = ALLOCATOR_BUDDY;
+			MemManage m(1 << 16, options);
+
+			// The arena is only 64 byte aligned, so a larger block is handed
+			// out from its first aligned byte
+			char *a = (char*)m.AllocAligned(100, 4096);
+			Assert::IsNotNull(a);
+			Assert::AreEqual<size_t>(0, (size_t)a % 4096);
+			memset(a, 0x5A, 100);
+
+			// It grows in place up to the end of its block, then moves
+			Assert::IsTrue(a == m.Realloc(a, 200));
+			char *b = (char*)m.Realloc(a, 8192);
+			Assert::IsNotNull(b);
+			Assert::AreEqual<int>(0x5A, b[99]);
+
+			char *c = (char*)m.AllocAligned(64, 4096);
+			Assert::AreEqual<size_t>(0, (size_t)c % 4096);
+			m.Free(b);
+			m.Free(c);
+			Assert::AreEqual<size_t>(1 << 16, m.Avail());
+			Assert::AreEqual<size_t>(1 << 16, m.LargestFree());
+		}
+
+		TEST_METHOD(MemManage_AllocAndFreeBatch)
+		{
+			MemManage m(64);
+			char *first = (char*)m.Alloc(4);
+			m.Free(first);
+
+			// A batch is carved back to back out of one free block, and
+			// whatever does not fit is left NULL
+			void *ptrs[20];
+			Assert::AreEqual<size_t>(16, m.AllocBatch(4, 20, ptrs));
+			for (int i = 0; i < 16; i++)
+				Assert::IsTrue(ptrs[i] == first + 4 * i);
+			Assert::IsNull(ptrs[16]);
+			Assert::AreEqual<size_t>(0, m.Avail());
+			for (int i = 0; i < 16; i++)
+				memset(ptrs[i], 0xAB, 4);
+
+			// Freeing in any order, with a stray pointer mixed in, merges the
+			// runs back into one block of null memory
+			void *batch[9] = { ptrs[3], ptrs[2], ptrs[9], ptrs[8], ptrs[15], ptrs[14], first + 1, ptrs[0], ptrs[1] };
+			m.FreeBatch(batch, 9);
+			Assert::AreEqual<size_t>(32, m.Avail());
+			Assert::AreEqual<size_t>(16, m.LargestFree());
+			void *rest[8] = { ptrs[4], ptrs[5], ptrs[6], ptrs[7], ptrs[10], ptrs[11], ptrs[12], ptrs[13] };
+			m.FreeBatch(rest, 8);
+			Assert::AreEqual<size_t>(64, m.LargestFree());
+			for (int i = 0; i < 64; i++)
+				Assert::AreEqual<int>(0, first[i]);
+		}
+
+		TEST_METHOD(MemManage_PlacementPolicies)
+		{
+			// Holes of 24 and 6 bytes between used blocks, 22 free at the end
+			PlacementPolicy policies[] = { PLACE_SEGREGATED, PLACE_FIRST_FIT, PLACE_NEXT_FIT, PLACE_BEST_FIT, PLACE_WORST_FIT };
+			int expected[] = { 32, 4, 42, 32, 4 };
+			for (int i = 0; i < 5; i++)
+			{
+				MemManageOptions options;
+				options.placement = policies[i];
+				MemManage m(64, options);
+				char *start = (char*)m.Alloc(4);
+				void *hole1 = m.Alloc(24);
+				m.Alloc(4);
+				void *hole2 = m.Alloc(6);
+				m.Alloc(4);
+				m.Free(hole1);
+				m.Free(hole2);
+
+				Assert::AreEqual<int>(expected[i], (int)((char*)m.Alloc(5) - start));
+				if (policies[i] == PLACE_NEXT_FIT)
+				{
+					// The rover carries on from the last block used and wraps
+					Assert::IsTrue(start + 47 == m.Alloc(17));
+					Assert::IsTrue(start + 4 == m.Alloc(5));
+				}
+				Assert::AreEqual<size_t>(64 - 12 - 5 - (policies[i] == PLACE_NEXT_FIT ? 22 : 0), m.Avail());
+			}
+		}
+
+		TEST_METHOD(MemManage_StatsCountBlocksAndCalls)
+		{
+			MemManage m(64);
+			void *a = m.Alloc(8);
+			void *b = m.Alloc(8);
+			m.Alloc(8);
+			m.Free(b);
+			Assert::IsNull(m.Alloc(100));
+			m.Realloc(a, 4);
+
+			// The 4 bytes Realloc gave back merge with b's block
+			MemStats stats = m.Stats();
+			Assert::AreEqual<size_t>(64, stats.totalBytes);
+			Assert::AreEqual<size_t>(52, stats.freeBytes);
+			Assert::AreEqual<size_t>(2, stats.liveBlocks);
+			Assert::AreEqual<size_t>(2, stats.freeBlocks);
+			Assert::AreEqual<size_t>(40, stats.largestFree);
+			Assert::AreEqual(1.0 - 40.0 / 52.0, stats.fragmentation, 1e-9);
+			Assert::AreEqual<unsigned long long>(4, stats.ops.calls[OP_ALLOC]);
+			Assert::AreEqual<unsigned long long>(1, stats.ops.calls[OP_FREE]);
+			Assert::AreEqual<unsigned long long>(1, stats.ops.calls[OP_REALLOC]);
+			Assert::AreEqual<unsigned long long>(1, stats.ops.failed);
+
+			// 8 byte requests fall in the 8 to 15 bucket, 100 in 64 to 127
+			Assert::AreEqual<unsigned long long>(3, stats.ops.allocSizes[4]);
+			Assert::AreEqual<unsigned long long>(1, stats.ops.allocSizes[3]);
+			Assert::AreEqual<unsigned long long>(1, stats.ops.allocSizes[7]);
+			unsigned long long searches = 0;
+			for (int i = 0; i < STATS_BUCKETS; i++)
+				searches += stats.searchLengths[i];
+			Assert::IsTrue(searches >= 3);
+
+			MemManageOptions options;
+			options.allocator = ALLOCATOR_BUDDY;
+			MemManage buddy(256, options);
+			buddy.Alloc(16);
+			buddy.Alloc(16);
+			stats = buddy.Stats();
+			Assert::AreEqual<size_t>(2, stats.liveBlocks);
+			Assert::AreEqual<size_t>(3, stats.freeBlocks);
+			Assert::AreEqual<size_t>(128, stats.largestFree);
+
+			// Slab objects count as blocks, the slab itself does not
+			MemManageOptions slabOptions;
+			slabOptions.slabs = true;
+			MemManage slabs(1 << 20, slabOptions);
+			slabs.Free(slabs.Alloc(16));
+			Assert::AreEqual<size_t>(0, slabs.Stats().liveBlocks);
+			void *kept = slabs.Alloc(16);
+			slabs.Alloc(400);
+			Assert::AreEqual<size_t>(2, slabs.Stats().liveBlocks);
+			slabs.Free(kept);
+			Assert::AreEqual<size_t>(1, slabs.Stats().liveBlocks);
+
+			// Any run of calls has one in LATENCY_SAMPLE timed
+			MemManage timed(64);
+			for (unsigned int i = 0; i < 10 * LATENCY_SAMPLE; i++)
+				timed.Free(NULL);
+			stats = timed.Stats();
+			Assert::AreEqual<unsigned long long>(10 * LATENCY_SAMPLE, stats.ops.calls[OP_FREE]);
+			Assert::AreEqual<unsigned long long>(MEMMANAGE_LATENCY_STATS ? 10 : 0, stats.ops.timedCalls[OP_FREE]);
+		}
+
+		TEST_METHOD(MemManage_StatsExport)
+		{
+			MemManage m(64);
+			m.Alloc(8);
+			MemStats stats = m.Stats();
+
+			stringstream json;
+			stats.WriteJson(json);
+			string text = json.str();
+			Assert::IsTrue(text.find("{\"totalBytes\":64,\"freeBytes\":56,\"liveBlocks\":1,") == 0);
+			Assert::IsTrue(text.find("\"calls\":{\"alloc\":1,\"free\":0,\"realloc\":0}") != string::npos);
+			Assert::IsTrue(text.find("\"allocSizes\":[0,0,0,0,1]") != string::npos);
+
+			// Every row has a value for each column of the header
+			stringstream header, row;
+			MemStats::WriteCsvHeader(header);
+			stats.WriteCsv(row);
+			string headerText = header.str(), rowText = row.str();
+			Assert::AreEqual<size_t>(count(headerText.begin(), headerText.end(), ','), count(rowText.begin(), rowText.end(), ','));
+			Assert::IsTrue(rowText.find("64,56,1,1,56,0,0,1,") == 0);
+		}
+
+		TEST_METHOD(MemManage_SnapshotsCopyOnWrite)
+		{
+			MemManageOptions options;
+			options.backend = ARENA_SNAPSHOT;
+			MemManage *live = new MemManage(1 << 16, options);
+			char *a = (char*)live->Alloc(100);
+			memset(a, 'A', 100);
+
+			// Writes after a snapshot is taken stay out of it, in either
+			// direction, and so do writes after later snapshots
+			MemManage first(*live);
+			memset(a, 'B', 100);
+			MemManage second(*live);
+			memset(a, 'C', 100);
+			memset(first.Alloc(50), 'D', 50);
+			MemManage third;
+			third = first;
+
+			stringstream bytes;
+			live->Dump(0, 1, bytes, DUMP_RAW);
+			first.Dump(0, 1, bytes, DUMP_RAW);
+			second.Dump(0, 1, bytes, DUMP_RAW);
+			third.Dump(0, 1, bytes, DUMP_RAW);
+			third.Dump(100, 1, bytes, DUMP_RAW);
+			Assert::AreEqual<string>("CABAD", bytes.str());
+			Assert::AreEqual<size_t>(live->Avail(), second.Avail());
+			Assert::AreEqual<size_t>(live->Avail() - 50, third.Avail());
+
+			// Snapshots outlive the heap they were taken from
+			delete live;
+			stringstream after;
+			second.Dump(99, 2, after, DUMP_RAW);
+			Assert::AreEqual<string>(string("B\0", 2), after.str());
+		}
+
+		TEST_METHOD(MemManage_PersistsAcrossReopen)
+		{
+			struct Node
+			{
+				int value;
+				OffsetPtr<Node> next;
+			};
+			char const *path = "MemManageTests.heap";
+			remove(path);
+
+			MemManageOptions options;
+			options.backend = ARENA_FILE;
+			options.path = path;
+			size_t avail;
+			{
+				MemManage m(1 << 16, options);
+				Node *first = NULL;
+				for (int i = 0; i < 3; i++)
+				{
+					Node *node = (Node*)m.Alloc(sizeof(Node));
+					node->value = i;
+					node->next = first;
+					first = node;
+				}
+				m.SetRoot(first);
+				avail = m.Avail();
+			}
+
+			// The size is only used when the file is created
+			{
+				MemManage m(0, options);
+				Assert::AreEqual<size_t>(1 << 16, m.Total());
+				Assert::AreEqual<size_t>(avail, m.Avail());
+				int values = 0;
+				for (Node *node = (Node*)m.Root(); node != NULL; node = node->next)
+					values = values * 10 + node->value + 1;
+				Assert::AreEqual(321, values);
+
+				// Copies are ordinary heaps holding the same data
+				MemManage copy(m);
+				stringstream original, copied;
+				m.Dump(0, m.Total(), original, DUMP_RAW);
+				copy.Dump(0, copy.Total(), copied, DUMP_RAW);
+				Assert::IsTrue(original.str() == copied.str());
+				Assert::AreEqual<size_t>(avail, copy.Avail());
+				Assert::IsNull(copy.Root());
+			}
+
+			// A file that does not hold a heap leaves it empty
+			ofstream(path, ios::binary) << "not a heap";
+			{
+				MemManage m(1 << 16, options);
+				Assert::AreEqual<size_t>(0, m.Total());
+				Assert::IsNull(m.Alloc(1));
+			}
+			remove(path);
+		}
+
+		TEST_METHOD(MemManage_SharesMemoryByOffset)
+		{
+			char const *name = "/MemManageTests.shared";
+			MemManage::Unlink(name);
+
+			// Two heaps opening the segment stand in for two processes, each
+			// mapping it at an address of its own
+			MemManageOptions options;
+			options.backend = ARENA_SHARED;
+			options.path = name;
+			MemManage producer(1 << 16, options);
+			MemManage consumer(0, options);
+			Assert::AreEqual<size_t>(1 << 16, consumer.Total());
+
+			char *buffer = (char*)producer.Alloc(1000);
+			memset(buffer, 'P', 1000);
+			size_t offset = producer.Offset(buffer);
+			char *seen = (char*)consumer.Address(offset);
+			Assert::AreEqual('P', seen[999]);
+			Assert::AreEqual<size_t>(producer.Avail(), consumer.Avail());
+
+			// Either side can free it
+			consumer.Free(seen);
+			Assert::AreEqual<size_t>(1 << 16, producer.Avail());
+			Assert::AreEqual(MemManage::NO_OFFSET, producer.Offset(&offset));
+			Assert::IsNull(consumer.Address(1 << 16));
+
+			// Once unlinked the next heap gets a segment of its own
+			MemManage::Unlink(name);
+			memset(producer.Alloc(10), 'Q', 10);
+			MemManage later(1 << 12, options);
+			Assert::AreEqual<size_t>(1 << 12, later.Avail());
+			MemManage::Unlink(name);
+		}
+
+		TEST_METHOD(MemManage_DumpRange)
+		{
+			MemManage m(20);
+			memcpy(m.Alloc(4), "ABCD", 4);
+
+			// The whole arena as rows of 16, the last one left unended
+			stringstream all;
+			all << m;
+			Assert::AreEqual<string>("41 42 43 44 00 00 00 00 00 00 00 00 00 00 00 00\n00 00 00 00", all.str());
+
+			// A range is clipped to the arena and its rows break at multiples
+			// of 16, each led by its offset
+			stringstream hex;
+			m.Dump(2, 100, hex);
+			Assert::AreEqual<string>("00000002: 43 44 00 00 00 00 00 00 00 00 00 00 00 00\n00000010: 00 00 00 00\n", hex.str());
+
+			stringstream raw;
+			m.Dump(1, 3, raw, DUMP_RAW);
+			Assert::AreEqual<string>("BCD", raw.str());
+
+			stringstream none;
+			m.Dump(20, 4, none);
+			Assert::AreEqual<size_t>(0, none.str().size());
+		}
+
+		TEST_METHOD(MemManage_DumpBlocks)
+		{
+			MemManage m(24);
+			memcpy(m.Alloc(2), "AB", 2);
+			MemHandle h = m.AllocHandle(4);
+			m.Pin(h);
+
+			stringstream out;
+			m.Dump(1, 6, out, DUMP_BLOCKS);
+			Assert::AreEqual<string>(
+				"-- 00000000 2 bytes used\n"
+				"00000001: 42\n"
+				"-- 00000002 4 bytes used, handle 1, pinned\n"
+				"00000002: 00 00 00 00\n"
+				"-- 00000006 18 bytes free\n"
+				"00000006: 00\n", out.str());
+		}
     };
 }
\ No newline at end of file
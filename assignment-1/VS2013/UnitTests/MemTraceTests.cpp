@@ -0,0 +1,115 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "..\MemManage\MemManage.h"
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace std;
+
+namespace UnitTests
+{
+    TEST_CLASS(MemTraceTests)
+    {
+    public:
+        TEST_METHOD(MemTrace_RecordsAndReadsBack)
+        {
+            stringstream stream;
+            TraceWriter writer(stream);
+            MemManage mem(1024);
+            mem.SetTrace(&writer);
+
+            void *a = mem.Alloc(10);
+            void *b = mem.Alloc(20);
+            Assert::IsNull(mem.Alloc(4096));
+            a = mem.Realloc(a, 30);
+            mem.Free(b);
+            int notAllocated;
+            mem.Free(&notAllocated);
+            mem.SetTrace(NULL);
+            mem.Free(a);
+
+            TraceReader reader(stream);
+            Assert::IsTrue(reader.IsValid());
+            TraceEvent e;
+            Assert::IsTrue(reader.Next(e));
+            Assert::IsTrue(e.op == TRACE_ALLOC);
+            Assert::AreEqual<unsigned int>(0, e.id);
+            Assert::AreEqual<unsigned long long>(10, e.size);
+            Assert::IsTrue(reader.Next(e));
+            Assert::IsTrue(e.op == TRACE_ALLOC);
+            Assert::AreEqual<unsigned int>(1, e.id);
+            Assert::AreEqual<unsigned long long>(20, e.size);
+            Assert::IsTrue(reader.Next(e));
+            Assert::IsTrue(e.op == TRACE_REALLOC);
+            Assert::AreEqual<unsigned int>(0, e.id);
+            Assert::AreEqual<unsigned long long>(30, e.size);
+            Assert::IsTrue(reader.Next(e));
+            Assert::IsTrue(e.op == TRACE_FREE);
+            Assert::AreEqual<unsigned int>(1, e.id);
+            Assert::IsFalse(reader.Next(e));
+        }
+
+        TEST_METHOD(MemTrace_OrdersCallsAcrossThreads)
+        {
+            const int THREADS = 4;
+            const int ROUNDS = 2000;
+            stringstream stream;
+            TraceWriter writer(stream);
+            MemManageOptions options;
+            options.threadSafe = true;
+            MemManage mem(1 << 22, options);
+            mem.SetTrace(&writer);
+
+            // Reallocs past the size class move, freeing blocks other threads
+            // are being handed at the same time
+            vector<thread> threads;
+            for (int t = 0; t < THREADS; t++)
+            {
+                threads.push_back(thread([&mem]()
+                {
+                    for (int i = 0; i < ROUNDS; i++)
+                    {
+                        void *p = mem.Alloc(16 + i % 64);
+                        p = mem.Realloc(p, 2048);
+                        mem.Free(p);
+                    }
+                }));
+            }
+            for (int t = 0; t < THREADS; t++)
+                threads[t].join();
+            mem.SetTrace(NULL);
+
+            // Every free and realloc names an allocation still live then
+            TraceReader reader(stream);
+            TraceEvent e;
+            set<unsigned int> live;
+            int frees = 0;
+            while (reader.Next(e))
+            {
+                if (e.op == TRACE_ALLOC)
+                    live.insert(e.id);
+                else
+                    Assert::IsTrue(live.count(e.id) == 1);
+                if (e.op == TRACE_FREE)
+                {
+                    live.erase(e.id);
+                    frees++;
+                }
+            }
+            Assert::AreEqual(THREADS * ROUNDS, frees);
+            Assert::IsTrue(live.empty());
+        }
+
+        TEST_METHOD(MemTrace_RejectsOtherFiles)
+        {
+            stringstream stream("not a trace");
+            TraceReader reader(stream);
+            Assert::IsFalse(reader.IsValid());
+            TraceEvent e;
+            Assert::IsFalse(reader.Next(e));
+        }
+    };
+}